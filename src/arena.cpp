@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "arena.h"
+
+std::size_t defaultHighWaterMark = std::size_t(512) << 20;
+
+Arena::Arena(const std::size_t highWaterMark, const std::size_t chunkSize) :
+    highWaterMark(highWaterMark),
+    chunkSize(chunkSize)
+{}
+
+Arena::~Arena() {
+    for (Chunk& chunk : chunks) {
+        std::free(chunk.data);
+    }
+}
+
+Arena::Chunk* Arena::addChunk(std::size_t size) {
+    size = std::max(size, chunkSize);
+    void* data = nullptr;
+    if (posix_memalign(&data, alignment, size) != 0) {
+        return nullptr;
+    }
+    // touch every page now so that images do not page fault on it later
+    std::memset(data, 0, size);
+    chunks.push_back(Chunk{ (char*)data, size, 0 });
+    statistics.capacity += size;
+    statistics.chunkAllocations += 1;
+    return &chunks.back();
+}
+
+void* Arena::allocate(std::size_t size) {
+    size = (size + alignment - 1) / alignment * alignment;
+
+    // the first chunk with room, there are only a few chunks
+    Chunk* chunk = nullptr;
+    for (Chunk& candidate : chunks) {
+        if (candidate.size - candidate.used >= size) {
+            chunk = &candidate;
+            break;
+        }
+    }
+    if (chunk == nullptr) {
+        chunk = addChunk(size);
+        if (chunk == nullptr) {
+            return nullptr;
+        }
+    }
+
+    void* const memory = chunk->data + chunk->used;
+    chunk->used += size;
+    statistics.used += size;
+    statistics.peak = std::max(statistics.peak, statistics.used);
+    return memory;
+}
+
+void Arena::reserve(const std::size_t size) {
+    for (const Chunk& chunk : chunks) {
+        if (chunk.size - chunk.used >= size) {
+            return;
+        }
+    }
+    addChunk(size);
+}
+
+void Arena::reset() {
+    for (Chunk& chunk : chunks) {
+        chunk.used = 0;
+    }
+    statistics.used = 0;
+    statistics.resets += 1;
+
+    // the newest chunks go first, the older ones are what most images need
+    while (statistics.capacity > highWaterMark && !chunks.empty()) {
+        std::free(chunks.back().data);
+        statistics.capacity -= chunks.back().size;
+        statistics.chunkReleases += 1;
+        chunks.pop_back();
+    }
+}
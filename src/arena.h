@@ -0,0 +1,121 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// bytes an arena keeps after a reset unless it is given its own limit, set by --arena-limit
+extern std::size_t defaultHighWaterMark;
+
+// what an arena did since it was made
+struct ArenaStats {
+    std::size_t used = 0;               // bytes handed out since the last reset
+    std::size_t peak = 0;               // most bytes handed out between two resets
+    std::size_t capacity = 0;           // bytes held in chunks
+    std::size_t chunkAllocations = 0;   // chunks allocated and faulted in from the system
+    std::size_t chunkReleases = 0;      // chunks given back because capacity was above the high-water mark
+    std::size_t resets = 0;
+};
+
+// memory for one image at a time, owned by one decoder and so by one thread. Allocations are 64 byte
+// aligned and come from chunks which are faulted in when they are made and kept from image to image,
+// reset() frees all allocations at once.
+class Arena {
+public:
+    static const std::size_t alignment = 64;
+
+    explicit Arena(std::size_t highWaterMark = defaultHighWaterMark, std::size_t chunkSize = 1 << 20);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // return nullptr if the memory could not be allocated
+    void* allocate(std::size_t size);
+
+    // count default constructed objects, they are never destructed so they must not need to be
+    template <typename T>
+    T* allocate(const std::size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destructed");
+        void* const memory = allocate(count * sizeof(T));
+        if (memory == nullptr) {
+            return nullptr;
+        }
+        return new (memory) T[count];
+    }
+
+    // make sure one allocation of size bytes after a reset needs no new chunk
+    void reserve(std::size_t size);
+
+    // forget all allocations, then give chunks back until capacity is at most the high-water mark
+    void reset();
+
+    const ArenaStats& stats() const {
+        return statistics;
+    }
+
+private:
+    struct Chunk {
+        char* data;
+        std::size_t size;
+        std::size_t used;
+    };
+
+    Chunk* addChunk(std::size_t size);
+
+    std::vector<Chunk> chunks;
+    const std::size_t highWaterMark;
+    const std::size_t chunkSize;
+    ArenaStats statistics;
+};
+
+// allocator for standard containers in an arena, with no arena it uses the global allocator.
+// Memory of an arena is only given back by resetting it.
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+    // containers take the arena of the container they are assigned or swapped with
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    Arena* arena = nullptr;
+
+    ArenaAllocator() = default;
+    explicit ArenaAllocator(Arena* a) : arena(a) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(const std::size_t count) {
+        if (arena == nullptr) {
+            return static_cast<T*>(::operator new(count * sizeof(T)));
+        }
+        void* const memory = arena->allocate(count * sizeof(T));
+        if (memory == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(memory);
+    }
+
+    void deallocate(T* const data, const std::size_t) {
+        if (arena == nullptr) {
+            ::operator delete(data);
+        }
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena != b.arena;
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif  // ARENA_H
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "benchmark.h"
+#include "decoder.h"
+#include "verify.h"
+
+// peak resident set size of the process in kB since the last resetPeakRSS()
+long peakRSS() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtol(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// linux resets the peak resident set size when 5 is written to clear_refs
+void resetPeakRSS() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+}
+
+struct BenchmarkInput {
+    std::string filename;
+    std::vector<byte> data;
+    uint width = 0;
+    uint height = 0;
+};
+
+bool decodeFromMemory(DecoderContext& context, const std::vector<byte>& data) {
+    if (!startImage(context)) {
+        return false;
+    }
+    MemoryBuffer buffer(data.data(), data.size());
+    std::istream inFile(&buffer);
+    readJPG(inFile, context.header);
+    return context.header->valid && decodeImage(context);
+}
+
+// arena is of one decoder, or of all decoders of a batch with the largest peak and all chunk allocations
+void writeBenchmarkRow(std::ostream& csvFile, const std::string& mode, const std::string& filename, const uint width,
+        const uint height, const uint numOfThreads, const uint images, const double seconds, const double megapixels,
+        const long peakRSSKilobytes, const ArenaStats& arena) {
+    std::ostringstream row;
+    row << mode << ',' << filename << ',' << width << ',' << height << ',' << numOfThreads << ',' << images << ','
+        << seconds << ',' << (images / seconds) << ',' << (megapixels / seconds) << ',' << peakRSSKilobytes << ','
+        << (arena.peak >> 10) << ',' << arena.chunkAllocations << '\n';
+    std::cout << row.str();
+    if (csvFile) {
+        csvFile << row.str();
+    }
+}
+
+int benchmark(const std::vector<std::string>& filenames, uint maxThreads, const uint iterations,
+        const std::string& csvFilename, const uint huffmanThreads) {
+    if (maxThreads == 0) {
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::vector<BenchmarkInput> inputs;
+    for (const std::string& filename : filenames) {
+        std::ifstream inFile = std::ifstream(filename, std::ios::in | std::ios::binary);
+        if (!inFile.is_open()) {
+            std::cout << "Error, input file cannot be opened --" << filename << "--\n";
+            continue;
+        }
+        BenchmarkInput input;
+        input.filename = filename;
+        input.data.assign(std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>());
+        inputs.push_back(std::move(input));
+    }
+
+    std::ofstream csvFile;
+    if (!csvFilename.empty()) {
+        csvFile.open(csvFilename);
+        if (!csvFile.is_open()) {
+            std::cout << "Error, csv file cannot be opened --" << csvFilename << "--\n";
+            return 1;
+        }
+    }
+    const std::string columns = "mode,file,width,height,threads,images,seconds,images_per_second,megapixels_per_second,peak_rss_kb,"
+        "arena_peak_kb,arena_chunk_allocations\n";
+    std::cout << columns;
+    if (csvFile) {
+        csvFile << columns;
+    }
+
+    // single image latency, files which do not decode are left out of the batch
+    std::vector<const BenchmarkInput*> batch;
+    double batchMegapixels = 0.0;
+    for (BenchmarkInput& input : inputs) {
+        // the decoding context is freed before verify runs, so its peak RSS leaves out the decoding buffers
+        double megapixels = 0.0;
+        {
+            DecoderContext context;
+            context.huffmanThreads = huffmanThreads;
+            resetPeakRSS();
+            bool valid = true;
+            const auto start = std::chrono::steady_clock::now();
+            for (uint i = 0; i < iterations && valid; i++) {
+                valid = decodeFromMemory(context, input.data);
+            }
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            if (!valid) {
+                std::cout << "Error - could not decode --" << input.filename << "--, skipped";
+                if (context.header != nullptr && !context.header->valid) {
+                    std::cout << ": " << context.header->error;
+                }
+                std::cout << '\n';
+                continue;
+            }
+
+            input.width = context.header->width;
+            input.height = context.header->height;
+            megapixels = input.width * (double)input.height / 1e6;
+            writeBenchmarkRow(csvFile, "single", input.filename, input.width, input.height, 1, iterations,
+                    elapsed.count(), megapixels * iterations, peakRSS(), context.arena.stats());
+        }
+
+        // the same file checked with verifyJPG() instead of decoded
+        DecoderContext verifyContext;
+        resetPeakRSS();
+        const auto verifyStart = std::chrono::steady_clock::now();
+        for (uint i = 0; i < iterations; i++) {
+            verifyJPG(verifyContext, input.data.data(), input.data.size());
+        }
+        const std::chrono::duration<double> verifyElapsed = std::chrono::steady_clock::now() - verifyStart;
+        writeBenchmarkRow(csvFile, "verify", input.filename, input.width, input.height, 1, iterations,
+                verifyElapsed.count(), megapixels * iterations, peakRSS(), verifyContext.arena.stats());
+        batch.push_back(&input);
+        batchMegapixels += megapixels;
+    }
+    if (batch.empty()) {
+        return 1;
+    }
+
+    const uint numOfJobs = batch.size() * iterations;
+    for (uint numOfThreads = 1; numOfThreads <= maxThreads; numOfThreads++) {
+        std::atomic<uint> nextJob(0);
+        std::vector<std::thread> workers;
+        std::vector<ArenaStats> arenas(numOfThreads);
+        resetPeakRSS();
+        const auto start = std::chrono::steady_clock::now();
+        for (uint i = 0; i < numOfThreads; i++) {
+            workers.emplace_back([&, i]() {
+                DecoderContext context;
+                context.huffmanThreads = huffmanThreads;
+                for (uint job = nextJob++; job < numOfJobs; job = nextJob++) {
+                    decodeFromMemory(context, batch[job % batch.size()]->data);
+                }
+                arenas[i] = context.arena.stats();
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        ArenaStats arena;
+        for (const ArenaStats& worker : arenas) {
+            arena.peak = std::max(arena.peak, worker.peak);
+            arena.chunkAllocations += worker.chunkAllocations;
+        }
+        writeBenchmarkRow(csvFile, "batch", "*", 0, 0, numOfThreads, numOfJobs, elapsed.count(),
+                batchMegapixels * iterations, peakRSS(), arena);
+    }
+    return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <vector>
+
+#include "jpg.h"
+
+// decode every file alone on one thread, then decode all files together as a batch at 1 to
+// maxThreads threads, every thread with its own buffers. Files are read into memory up front
+// so only decoding is measured.
+int benchmark(const std::vector<std::string>& filenames, uint maxThreads, const uint iterations,
+        const std::string& csvFilename, const uint huffmanThreads);
+
+#endif  // BENCHMARK_H
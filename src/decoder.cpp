@@ -1,13 +1,43 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iterator>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "decoder.h"
+#include "server.h"
+#include "verify.h"
+
+// log every marker as it is read, only the command line mode that prints headers does
+bool logMarkers = false;
+
+// mark header as invalid and keep why for the caller to report
+void setError(Header* const header, const char* const format, ...) {
+    va_list args;
+    va_start(args, format);
+    std::vsnprintf(header->error, sizeof(header->error), format, args);
+    va_end(args);
+    header->valid = false;
+    if (logMarkers) {
+        std::cout << "Error - " << header->error << '\n';
+    }
+}
 
-#include "jpg.h"
-
-void readStartOfScan(std::ifstream& inFile, Header* header) {
-    std::cout << "Reading SOS marker\n";
+void readStartOfScan(std::istream& inFile, Header* header) {
+    if (logMarkers) {
+        std::cout << "Reading SOS marker\n";
+    }
     if (header->numOfComponents == 0) {
-        std::cout << "Error - SOS detected before SOF\n";
-        header->valid = false;
+        setError(header, "SOS detected before SOF");
         return;
     }
 
@@ -31,22 +61,24 @@ void readStartOfScan(std::ifstream& inFile, Header* header) {
         // color components are from 1 to 3 but our indexes are 0 to 2
         ColorComponent* component = &header->colorComponents[componentID - 1];
         if (component->used) {
-            std::cout << "Error - Duplicate Color Component ID\n";
-            header->valid = false;
+            setError(header, "Duplicate Color Component ID");
             return;
         }
         component->used = true;
 
         byte huffmanTableIDs = inFile.get();
-        std::cout << "xdd-- component: " << (uint)componentID << " huffmanTableIDs: " << std::hex << (uint)huffmanTableIDs << std::dec << "\n";
+        if (logMarkers) {
+            std::cout << "xdd-- component: " << (uint)componentID << " huffmanTableIDs: " << std::hex << (uint)huffmanTableIDs << std::dec << "\n";
+        }
         component->huffmanDCTableID = (huffmanTableIDs >> 4);
         component->huffmanACTableID = (huffmanTableIDs & 0x0F);
-        std::cout << "xdd-- component: " << (uint)componentID << " huffmanTableIDs: " << std::hex << (uint)component->huffmanDCTableID << std::dec << "\n";
-        std::cout << "xdd-- component: " << (uint)componentID << " huffmanTableIDs: " << std::hex << (uint)component->huffmanACTableID << std::dec << "\n";
+        if (logMarkers) {
+            std::cout << "xdd-- component: " << (uint)componentID << " huffmanTableIDs: " << std::hex << (uint)component->huffmanDCTableID << std::dec << "\n";
+            std::cout << "xdd-- component: " << (uint)componentID << " huffmanTableIDs: " << std::hex << (uint)component->huffmanACTableID << std::dec << "\n";
+        }
         
         if (component->huffmanACTableID > 3 || component->huffmanDCTableID > 3) {
-            std::cout << "Error - Invalit Huffman DC or AC TableID\n";
-            header->valid = false;
+            setError(header, "Invalit Huffman DC or AC TableID");
             return;
         }
     }
@@ -58,59 +90,55 @@ void readStartOfScan(std::ifstream& inFile, Header* header) {
 
     // Baseline JPGs do not use spectral selection of successive approximation
     if (header->startOfSelection != 0 || header->endOfSelection != 63) {
-        std::cout << "Error - Invalid spectral selection for baseline jpeg\n";
-        header->valid = false;
+        setError(header, "Invalid spectral selection for baseline jpeg");
         return;
     }
 
     if (header->successiveApproximationHigh != 0 || header->successiveApproximationLow != 0) {
-        std::cout << "Error - Invalid successive approximation fo r baseline jpeg\n";
-        header->valid = false;
+        setError(header, "Invalid successive approximation fo r baseline jpeg");
         return;
     }
 
     if (length - 6 - (2 * numComponents) != 0) {
-        std::cout << "Error - Invalid SOS Marker\n";
-        header->valid = false;
+        setError(header, "Invalid SOS Marker");
         return;
     }
 }
 
-void readStartOfFrame(std::ifstream& inFile, Header* header) {
-    std::cout << "Reading SOF marker\n";
+void readStartOfFrame(std::istream& inFile, Header* header) {
+    if (logMarkers) {
+        std::cout << "Reading SOF marker\n";
+    }
     if (header->numOfComponents != 0) {
-        std::cout << "Error - Multiple SOFs are deteceted.\n";
-        header->valid = false;
+        setError(header, "Multiple SOFs are deteceted.");
         return;
     }
 
     uint length = ((inFile.get() << 8) + inFile.get());
-    std::cout << "length: " << (uint)length << '\n';
+    if (logMarkers) {
+        std::cout << "length: " << (uint)length << '\n';
+    }
 
     byte precision = inFile.get();
     if (precision != 8) {
-        std::cout << "Error - Invalid precision\n";
-        header->valid = false;
+        setError(header, "Invalid precision");
         return;
     }
 
     header->height = ((inFile.get() << 8) + inFile.get());
     header->width = ((inFile.get() << 8) + inFile.get());
     if (header->height == 0 || header->width == 0) {
-        std::cout << "Error - Invalid height or width\n";
-        header->valid = false;
+        setError(header, "Invalid height or width");
         return;
     }
 
     header->numOfComponents = inFile.get();
     if (header->numOfComponents == 4) {
-        std::cout << "Error - CMYK components not supported.\n";
-        header->valid = false;
+        setError(header, "CMYK components not supported.");
         return; 
     }
     if (header->numOfComponents == 0) {
-        std::cout << "Error - 0 components not supported.\n";
-        header->valid = false;
+        setError(header, "0 components not supported.");
         return; 
     }
 
@@ -123,49 +151,80 @@ void readStartOfFrame(std::ifstream& inFile, Header* header) {
             componentID += 1;
         }
         if (componentID == 4 || componentID == 5) {
-            std::cout << "Error - YIQ format not supported\n";
-            header->valid = false;
+            setError(header, "YIQ format not supported");
             return; 
         }
         if (componentID == 0 || componentID > 3) {
-            std::cout << "Error - invalid component id\n";
-            header->valid = false;
+            setError(header, "invalid component id");
             return; 
         }
 
         // color components for Y Cr Cb format is 1, 2, 3. So we subtract 1 from those
         ColorComponent* component = &header->colorComponents[componentID - 1];
         if (component->used) {
-            std::cout << "Error - duplicate color component\n";
-            header->valid = false;
+            setError(header, "duplicate color component");
             return; 
         }
         component->used = true;
         byte samplingFactor = inFile.get();
         component->horizontalSamplingFactor = samplingFactor >> 4;
         component->verticalSamplingFactor = samplingFactor & 0x0F;
+        if (componentID == 1) {
+            // only luminance may have sampling factors other than 1, and only up to 2
+            if ((component->horizontalSamplingFactor != 1 && component->horizontalSamplingFactor != 2) ||
+                (component->verticalSamplingFactor != 1 && component->verticalSamplingFactor != 2)) {
+                setError(header, "sampling factors not supported");
+                return;
+            }
+            header->horizontalSamplingFactor = component->horizontalSamplingFactor;
+            header->verticalSamplingFactor = component->verticalSamplingFactor;
+        } else if (component->horizontalSamplingFactor != 1 || component->verticalSamplingFactor != 1) {
+            setError(header, "sampling factors not supported");
+            return;
+        }
 
         component->quantizationTableID = inFile.get();
         if (component->quantizationTableID > 3) {
-            std::cout << "Error - invalid quantization table id for color component\n";
-            header->valid = false;
+            setError(header, "invalid quantization table id for color component");
             return; 
         }
     }
 
     // check if length lines up
     if (length - 8 - (header->numOfComponents * 3) != 0) {
-        std::cout << "Error - invalid SOF marker\n";
-        header->valid = false;
+        setError(header, "invalid SOF marker");
         return; 
     }
 
+    // a single component scan is not interleaved, every MCU is a single block
+    if (header->numOfComponents == 1) {
+        header->colorComponents[0].horizontalSamplingFactor = 1;
+        header->colorComponents[0].verticalSamplingFactor = 1;
+        header->horizontalSamplingFactor = 1;
+        header->verticalSamplingFactor = 1;
+    }
+
+    header->mcuHeight = (header->height + 7) / 8;
+    header->mcuWidth = (header->width + 7) / 8;
+    header->mcuHeightReal = header->mcuHeight;
+    header->mcuWidthReal = header->mcuWidth;
+    if (header->verticalSamplingFactor == 2 && header->mcuHeightReal % 2 == 1) {
+        header->mcuHeightReal += 1;
+    }
+    if (header->horizontalSamplingFactor == 2 && header->mcuWidthReal % 2 == 1) {
+        header->mcuWidthReal += 1;
+    }
+
 }
 
-void readAPPN(std::ifstream& inFile, Header* header) {
-    std::cout << "Reading APPN marker\n";
+void readAPPN(std::istream& inFile, Header* header) {
+    if (logMarkers) {
+        std::cout << "Reading APPN marker\n";
+    }
     uint length = ((inFile.get() << 8) + inFile.get());
-    std::cout << "length: " << (uint)length << '\n';
+    if (logMarkers) {
+        std::cout << "length: " << (uint)length << '\n';
+    }
     
     // length which is 2 bytes is included in length
     for (int i = 0; i < length - 2; i++) {
@@ -173,8 +232,10 @@ void readAPPN(std::ifstream& inFile, Header* header) {
     }
 }
 
-void readQuantizationTable(std::ifstream& inFile, Header* header) {
-    std::cout << "Reading DQT marker\n";
+void readQuantizationTable(std::istream& inFile, Header* header) {
+    if (logMarkers) {
+        std::cout << "Reading DQT marker\n";
+    }
     // using in length, length should be signed
     int length = ((inFile.get() << 8) + inFile.get());
     length -= 2;
@@ -186,8 +247,7 @@ void readQuantizationTable(std::ifstream& inFile, Header* header) {
         tableID = (tableInfo & 0x0F);
 
         if (tableID > 3) {
-            std::cout << "Error - Table id cannot be greater than 3. tableID: " << (uint)tableID << "\n";
-            header->valid = false;
+            setError(header, "Table id cannot be greater than 3. tableID: %u", (uint)tableID);
             return;
         }
 
@@ -210,16 +270,19 @@ void readQuantizationTable(std::ifstream& inFile, Header* header) {
     }
 
     if (length != 0) {
-        std::cout << "Error - invalid DQT Marker\n";
-        header->valid = false;
+        setError(header, "invalid DQT Marker");
         return;
     }
 }
 
-void readComment(std::ifstream& inFile, Header* header) {
-    std::cout << "Reading COM marker\n";
+void readComment(std::istream& inFile, Header* header) {
+    if (logMarkers) {
+        std::cout << "Reading COM marker\n";
+    }
     uint length = ((inFile.get() << 8) + inFile.get());
-    std::cout << "length: " << (uint)length << '\n';
+    if (logMarkers) {
+        std::cout << "length: " << (uint)length << '\n';
+    }
 
     // length which is 2 bytes is included in length
     for (int i = 0; i < length - 2; i++) {
@@ -227,10 +290,14 @@ void readComment(std::ifstream& inFile, Header* header) {
     }
 }
 
-void readHuffmanTable(std::ifstream& inFile, Header* header) {
-    std::cout << "Reading DHT marker\n";
+void readHuffmanTable(std::istream& inFile, Header* header) {
+    if (logMarkers) {
+        std::cout << "Reading DHT marker\n";
+    }
     int length = ((inFile.get() << 8) + inFile.get());
-    std::cout << "length: " << (uint)length << '\n';
+    if (logMarkers) {
+        std::cout << "length: " << (uint)length << '\n';
+    }
     length -= 2;
 
     while (length > 0) {
@@ -241,8 +308,7 @@ void readHuffmanTable(std::ifstream& inFile, Header* header) {
         bool ACTable = tableInfo >> 4;
 
         if (tableID > 3) {
-            std::cout << "Error - Table id cannot be greater than 3. tableID: " << (uint)tableID << "\n";
-            header->valid = false;
+            setError(header, "Table id cannot be greater than 3. tableID: %u", (uint)tableID);
             return;
         }
 
@@ -253,6 +319,7 @@ void readHuffmanTable(std::ifstream& inFile, Header* header) {
             hTable = &header->huffmanDCTables[tableID];
         }
         hTable->set = true;
+        hTable->built = false;
 
         hTable->offsets[0] = 0;
         uint allSymbols = 0;        // running sum of symbol count
@@ -262,8 +329,7 @@ void readHuffmanTable(std::ifstream& inFile, Header* header) {
         }
 
         if (allSymbols > 162) {
-            std::cout << "Error - Too many symbols in Huffman Table\n";
-            header->valid = false;
+            setError(header, "Too many symbols in Huffman Table");
             return;
         }
 
@@ -275,21 +341,24 @@ void readHuffmanTable(std::ifstream& inFile, Header* header) {
     }
     
     if (length != 0) {
-        std::cout << "Error - DHT invalid\n";
+        setError(header, "DHT invalid");
         return;
     }
 }
 
-void readRestartInterval(std::ifstream& inFile, Header* header) {
-    std::cout << "Reading DRI marker\n";
+void readRestartInterval(std::istream& inFile, Header* header) {
+    if (logMarkers) {
+        std::cout << "Reading DRI marker\n";
+    }
     uint length = ((inFile.get() << 8) + inFile.get());
-    std::cout << "length: " << (uint)length << '\n';
+    if (logMarkers) {
+        std::cout << "length: " << (uint)length << '\n';
+    }
 
     header->restartInterval = ((inFile.get() << 8) + inFile.get());
 
     if (length != 4) {
-        std::cout << "Error - invalid DRI Marker\n";
-        header->valid = false;
+        setError(header, "invalid DRI Marker");
         return;
     }
 }
@@ -372,30 +441,169 @@ void printHeader(const Header* const header) {
     std::cout << "Restart Interval: " << (uint)header->restartInterval << "\n";
 }
 
-Header* readJPG(const std::string& filename)
-{
-    // Open file in input and binary format
-    std::ifstream inFile = std::ifstream(filename, std::ios::in | std::ios::binary);
-    if (!inFile.is_open()) {
-        std::cout << "Error, input file cannot be opened --" << filename << "--\n";
-        return nullptr;
+// number of bytes from the position of a stream to its end, 0 if the stream can not seek
+std::size_t remainingBytes(std::istream& inFile) {
+    const std::streampos position = inFile.tellg();
+    if (position == std::streampos(-1)) {
+        return 0;
+    }
+    inFile.seekg(0, std::ios::end);
+    const std::streampos end = inFile.tellg();
+    inFile.seekg(position);
+    if (end == std::streampos(-1) || !inFile) {
+        inFile.clear();
+        return 0;
     }
+    return end - position;
+}
 
-    Header* header = new (std::nothrow) Header;
-    if (header == nullptr) {
-        std::cout << "Error, memory could not be allocated for Header.\n";
-        inFile.close();
+void generateCodes(HuffmanTable& hTable) {
+    uint code = 0;
+    // i is current code length - 1
+    for (uint i = 0; i < 16; i++) {
+        for (uint j = hTable.offsets[i]; j < hTable.offsets[i + 1]; j++) {
+            hTable.codes[j] = code;
+            code += 1;
+        }
+        // append a 0 to right end of the code candidate.
+        code <<= 1;
+    }
+
+    // a short code fills every lookup entry whose first bits are the code
+    std::memset(hTable.lookupLengths, 0, sizeof(hTable.lookupLengths));
+    for (uint length = 1; length <= huffmanLookupBits; length++) {
+        for (uint j = hTable.offsets[length - 1]; j < hTable.offsets[length]; j++) {
+            // tables with too many codes of a length have codes which can never be read
+            if (hTable.codes[j] >> length != 0) {
+                continue;
+            }
+            const uint first = hTable.codes[j] << (huffmanLookupBits - length);
+            const uint count = 1 << (huffmanLookupBits - length);
+            std::memset(hTable.lookupSymbols + first, hTable.symbols[j], count);
+            std::memset(hTable.lookupLengths + first, length, count);
+        }
+    }
+    hTable.built = true;
+}
+
+void setHuffmanTable(HuffmanTable& hTable, const byte* const counts, const byte* const symbols) {
+    hTable.offsets[0] = 0;
+    for (uint i = 0; i < 16; i++) {
+        hTable.offsets[i + 1] = hTable.offsets[i] + counts[i];
+    }
+    std::memcpy(hTable.symbols, symbols, hTable.offsets[16]);
+    hTable.set = true;
+    generateCodes(hTable);
+}
+
+// 64 bit FNV-1a
+unsigned long long hashBytes(const byte* const data, const std::size_t size) {
+    unsigned long long hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// read a DQT or DHT segment, tables of a segment seen before are copied from the cache
+// instead of being read and generated again
+void readTablesCached(std::istream& inFile, Header* const header, TableCache& cache, const byte marker) {
+    const uint length = ((inFile.get() << 8) + inFile.get());
+    if (!inFile || length < 2) {
+        setError(header, "Invalid table segment length");
+        return;
+    }
+    cache.segment.resize(length);
+    cache.segment[0] = length >> 8;
+    cache.segment[1] = length & 0xFF;
+    inFile.read((char*)cache.segment.data() + 2, length - 2);
+    if (!inFile) {
+        return;     // readJPG reports the premature end
+    }
+
+    const unsigned long long hash = hashBytes(cache.segment.data(), cache.segment.size()) ^ marker;
+    auto cached = cache.segments.find(hash);
+    if (cached != cache.segments.end() && cached->second.segment == cache.segment) {
+        cache.hits += 1;
+    } else {
+        cache.misses += 1;
+        Header* const scratch = &cache.scratch;
+        for (uint i = 0; i < 4; i++) {
+            scratch->quantizationTables[i].set = false;
+            scratch->huffmanDCTables[i].set = false;
+            scratch->huffmanACTables[i].set = false;
+        }
+        scratch->valid = true;
+        MemoryBuffer buffer(cache.segment.data(), cache.segment.size());
+        std::istream segment(&buffer);
+        if (marker == DQT) {
+            readQuantizationTable(segment, scratch);
+        } else {
+            readHuffmanTable(segment, scratch);
+        }
+        if (!scratch->valid) {
+            std::memcpy(header->error, scratch->error, sizeof(header->error));
+            header->valid = false;
+            return;
+        }
+
+        // a stream is not expected to switch between many tables, start over rather than grow
+        if (cache.segments.size() >= 64) {
+            cache.segments.clear();
+        }
+        CachedTables& tables = cache.segments[hash];
+        tables.segment = cache.segment;
+        tables.quantizationTables.clear();
+        tables.huffmanTables.clear();
+        for (uint i = 0; i < 4; i++) {
+            if (scratch->quantizationTables[i].set) {
+                tables.quantizationTables.emplace_back(i, scratch->quantizationTables[i]);
+            }
+            if (scratch->huffmanDCTables[i].set) {
+                generateCodes(scratch->huffmanDCTables[i]);
+                tables.huffmanTables.emplace_back(i, scratch->huffmanDCTables[i]);
+            }
+            if (scratch->huffmanACTables[i].set) {
+                generateCodes(scratch->huffmanACTables[i]);
+                tables.huffmanTables.emplace_back(i + 4, scratch->huffmanACTables[i]);
+            }
+        }
+        cached = cache.segments.find(hash);
+    }
+
+    for (const auto& table : cached->second.quantizationTables) {
+        header->quantizationTables[table.first] = table.second;
+    }
+    for (const auto& table : cached->second.huffmanTables) {
+        if (table.first < 4) {
+            header->huffmanDCTables[table.first] = table.second;
+        } else {
+            header->huffmanACTables[table.first - 4] = table.second;
+        }
+    }
+}
+
+// a header whose huffman data is also allocated in arena. It is never destructed, the next
+// reset of the arena takes it away.
+Header* newHeader(Arena& arena) {
+    void* const memory = arena.allocate(sizeof(Header));
+    if (memory == nullptr) {
         return nullptr;
     }
+    Header* const header = new (memory) Header;
+    header->huffmanData = ArenaVector<byte>(ArenaAllocator<byte>(&arena));
+    return header;
+}
 
+void readFrameHeader(std::istream& inFile, Header* const header, TableCache* const cache)
+{
     // read 2 bytes
     byte first = inFile.get();
     byte second = inFile.get();
     // verify
     if (first != 0xFF || second != SOI) {
-        header->valid = false;
-        inFile.close();
-        return header;
+        setError(header, "SOI was expected");
+        return;
     }
 
     int huffmanTablesRead = 0;
@@ -404,21 +612,19 @@ Header* readJPG(const std::string& filename)
     second = inFile.get();
     while (header->valid) {
         if (!inFile) {
-            std::cout << "Error - file ended prematurely --" << filename << "--\n";
-            header->valid = false;
-            inFile.close();
-            return header;
+            setError(header, "file ended prematurely");
+            return;
         }
         if (first != 0xFF) {
-            std::cout << "Error - Marker was expected --" << filename << "--\n";
-            header->valid = false;
-            inFile.close();
-            return header;
+            setError(header, "Marker was expected");
+            return;
         }
 
         if (second == SOS) {
             readStartOfScan(inFile, header);
             break;
+        } else if (second == DHT && cache != nullptr) {
+            readTablesCached(inFile, header, *cache, second);
         } else if (second == DHT) {
             readHuffmanTable(inFile, header);
         } else if (second == SOF0) {
@@ -426,6 +632,8 @@ Header* readJPG(const std::string& filename)
             readStartOfFrame(inFile, header);
         } else if (second == COM) {
             readComment(inFile, header);
+        } else if (second == DQT && cache != nullptr) {
+            readTablesCached(inFile, header, *cache, second);
         } else if (second == DQT) {
             readQuantizationTable(inFile, header);
         } else if (second == DRI) {
@@ -447,168 +655,749 @@ Header* readJPG(const std::string& filename)
             continue;
         }
         else if (second == SOI) {
-            std::cout << "Error - Start of Image not supported\n";
-            header->valid = false;
-            inFile.close();
-            return header;
+            setError(header, "Start of Image not supported");
+            return;
         }
         else if (second == EOI) {
-            std::cout << "Error - EOI encountered before SOS\n";
-            header->valid = false;
-            inFile.close();
-            return header;
+            setError(header, "EOI encountered before SOS");
+            return;
         }
         else if (second == DAC) {
-            std::cout << "Error - Arithmetic encoding not supported\n";
-            header->valid = false;
-            inFile.close();
-            return header;
+            setError(header, "Arithmetic encoding not supported");
+            return;
         }
         else if (second >= SOF1 && second <= SOF15) {
-            std::cout << "Error - Given SOF not supported SOF 0x" << std::hex << (uint)second << std::dec << '\n';
-            header->valid = false;
-            inFile.close();
-            return header;
+            setError(header, "Given SOF not supported SOF 0x%x", (uint)second);
+            return;
         }
         else {
-            std::cout << "Error - Unknown marker 0x" << std::hex << (uint)second << std::dec << '\n';
-            header->valid = false;
-            inFile.close();
-            return header;
-
+            setError(header, "Unknown marker 0x%x", (uint)second);
+            return;
         }
 
         first = inFile.get();
         second = inFile.get();
     }
+}
+
+// read the entropy coded data after SOS up to EOI into huffmanData, without stuffed bytes and restart markers.
+// remaining is the number of bytes left in inFile if it is known, or 0
+void readScanData(std::istream& inFile, Header* const header, const std::size_t remaining)
+{
+    // the scan is at most the rest of the input, reserve it instead of growing one byte at a time,
+    // arena memory of outgrown buffers is only reclaimed with the next image
+    if (remaining > 0) {
+        header->huffmanData.reserve(header->huffmanData.size() + remaining);
+    }
 
-    // After Start of Scan (SOS)
+    byte first = 0;
+    byte second = inFile.get();
 
-    if (header->valid) {
+    while (true) {
+        if (!inFile) {
+            setError(header, "File ended prematurely");
+            return;
+        }
+        first = second;
         second = inFile.get();
 
-        while (true) {
-            if (!inFile) {
-                std::cout << "Error - File ended prematurely\n";
-                header->valid = false;
-                inFile.close();
-                return header;
+        // if marker is found
+        if (first == 0xFF) {
+            // end of image
+            if (second == EOI) {
+                break;
             }
-            first = second;
-            second = inFile.get();
-
-            // if marker is found
-            if (first == 0xFF) {
-                // end of image
-                if (second == EOI) {
-                    break;
-                }
-                // actual 0xFF value to be stored
-                else if (second == 0x00) {
-                    header->huffmanData.push_back(first);
-                    // overwrite 0x00 with next byte
-                    second = inFile.get();
-                }
-                // restart marker
-                else if (RST0 <= second && second <= RST7) {
-                    // overwrite marker with next byte
-                    second = inFile.get();
-                }
-                //ignore multiple FFs in a row
-                else if (second == 0xFF) {
-                    // do nothing
-                    continue;
-                }
-                else {
-                    std::cout << "Error - invalid marker during compressed data scan 0x" << std::hex << (uint)second << std::dec << '\n';
-                    header->valid = false;
-                    inFile.close();
-                    return header;
-                }
-            } else {    // if first != 0xFF
-                // just store the data
+            // actual 0xFF value to be stored
+            else if (second == 0x00) {
                 header->huffmanData.push_back(first);
+                // overwrite 0x00 with next byte
+                second = inFile.get();
+            }
+            // restart marker
+            else if (RST0 <= second && second <= RST7) {
+                // overwrite marker with next byte
+                second = inFile.get();
             }
+            //ignore multiple FFs in a row
+            else if (second == 0xFF) {
+                // do nothing
+                continue;
+            }
+            else {
+                setError(header, "invalid marker during compressed data scan 0x%x", (uint)second);
+                return;
+            }
+        } else {    // if first != 0xFF
+            // just store the data
+            header->huffmanData.push_back(first);
         }
     }
+}
 
-    // validate header info
-    if (header->numOfComponents != 0 && header->numOfComponents != 3) {
-        std::cout << "Error - " << (uint)header->numOfComponents << " color components given (1 or 3 required)\n";
-        header->valid = false;
-        inFile.close();
-        return header;
+void validateHeader(Header* const header, TableCache* const cache)
+{
+    if (header->numOfComponents != 1 && header->numOfComponents != 3) {
+        setError(header, "%u color components given (1 or 3 required)", (uint)header->numOfComponents);
+        return;
+    }
+
+    if (cache != nullptr) {
+        bool anyHuffmanTable = false;
+        for (uint i = 0; i < 4; i++) {
+            anyHuffmanTable |= header->huffmanDCTables[i].set || header->huffmanACTables[i].set;
+        }
+        if (!anyHuffmanTable) {
+            cache->standardTablesUsed += 1;
+            for (uint i = 0; i < 2; i++) {
+                header->huffmanDCTables[i] = cache->standardDCTables[i];
+                header->huffmanACTables[i] = cache->standardACTables[i];
+            }
+        }
     }
 
     for (int i = 0; i < header->numOfComponents; i++) {
         if (header->quantizationTables[header->colorComponents[i].quantizationTableID].set == false) {
-            std::cout << "Error - Color component using uninitialized quantization table";
-            header->valid = false;
-            inFile.close();
-            return header;
+            setError(header, "Color component using uninitialized quantization table");
+            return;
         }
         if (header->huffmanDCTables[header->colorComponents[i].huffmanDCTableID].set == false) {
-            std::cout << "Error - Color component using uninitialized huffman DC table";
-            header->valid = false;
-            inFile.close();
-            return header;
+            setError(header, "Color component using uninitialized huffman DC table");
+            return;
         }
         if (header->huffmanACTables[header->colorComponents[i].huffmanACTableID].set == false) {
-            std::cout << "Error - Color component using uninitialized huffman AC table";
-            header->valid = false;
-            inFile.close();
-            return header;
+            setError(header, "Color component using uninitialized huffman AC table");
+            return;
         }
     }
+}
+
+void readJPG(std::istream& inFile, Header* const header, TableCache* const cache)
+{
+    readFrameHeader(inFile, header, cache);
+    if (header->valid) {
+        validateHeader(header, cache);
+    }
+    if (header->valid) {
+        // a block takes at most a 16 bit DC code with 11 bits of value and 63 16 bit AC codes with 10 bits
+        // each, plus a padding byte per restart. This bounds the scan when the stream holds more than this
+        // image, as Motion-JPEG does
+        const std::size_t numOfBlocks = (std::size_t)header->mcuHeightReal * header->mcuWidthReal * header->numOfComponents;
+        const std::size_t maxScanSize = numOfBlocks * ((16 + 11 + 63 * (16 + 10)) / 8 + 1) + numOfBlocks;
+        readScanData(inFile, header, std::min(remainingBytes(inFile), maxScanSize));
+    }
+}
+
+Header* readJPG(const std::string& filename, Arena& arena)
+{
+    // Open file in input and binary format
+    std::ifstream inFile = std::ifstream(filename, std::ios::in | std::ios::binary);
+    if (!inFile.is_open()) {
+        std::cout << "Error, input file cannot be opened --" << filename << "--\n";
+        return nullptr;
+    }
 
+    Header* header = newHeader(arena);
+    if (header == nullptr) {
+        std::cout << "Error, memory could not be allocated for Header.\n";
+        inFile.close();
+        return nullptr;
+    }
+
+    readJPG(inFile, header);
     inFile.close();
     return header;
 }
 
-void generateCodes(HuffmanTable& hTable) {
-    uint code = 0;
-    // i is current code length - 1
+// return the symbol from the huffman table that corresponds to the next huffman code read from the BitReader
+byte getNextSymbol(BitReader& b, const HuffmanTable& hTable) {
+    uint available = 0;
+    const uint bits = b.peekBits(huffmanLookupBits, available);
+    const byte length = hTable.lookupLengths[bits];
+    if (length != 0 && length <= available) {
+        b.skipBits(length);
+        return hTable.lookupSymbols[bits];
+    }
+
+    // codes longer than the lookup and the last bits of the data
+    uint currentCode = 0;
     for (uint i = 0; i < 16; i++) {
+        int bit = b.readBit();
+        if (bit == -1) {
+            return -1;
+        }
+        currentCode = (currentCode << 1) | bit;
         for (uint j = hTable.offsets[i]; j < hTable.offsets[i + 1]; j++) {
-            hTable.codes[j] = code;
-            code += 1;
+            if (currentCode == hTable.codes[j]) {
+                return hTable.symbols[j];
+            }
         }
-        // append a 0 to right end of the code candidate.
-        code <<= 1;
     }
+    return -1;
 }
 
-MCU* decodeHuffmanData(Header* const header) {
-    const int mcuHeight = (header->height + 7) / 8;
-    const int mcuWidth = (header->width + 7) / 8;
-    MCU* mcus = new (std::nothrow) MCU[mcuHeight * mcuWidth];
-    if (mcus == nullptr) {
-        std::cout << "Error - memory error.\n";
-        return nullptr;
+const char* decodeBlock(BitReader& b, int* const component, const HuffmanTable& dcTable,
+        const HuffmanTable& acTable, byte& endOfBlock, byte& nonzeroRows) {
+    endOfBlock = 0;
+    nonzeroRows = 0;
+
+    // get the DC value for this MCU component
+    byte length = getNextSymbol(b, dcTable);
+    if (length == (byte)-1) {
+        return "Invalid DC value";
     }
+    if (length > 11) {
+        return "DC coefficient length greater than 11";
+    }
+
+    int coeff = b.readBits(length);
+    if (coeff == -1) {
+        return "Invalid DC value";
+    }
+    if (length != 0 && coeff < (1 << (length - 1))) {
+        coeff -= (1 << length) - 1;
+    }
+    component[0] = coeff;
+
+    // get the AC values for this MCU component
+    uint i = 1;
+    while (i < 64) {
+        byte symbol = getNextSymbol(b, acTable);
+        if (symbol == (byte)-1) {
+            return "Invalid AC value";
+        }
+
+        // symbol 0x00 means fill remainder of component with 0
+        if (symbol == 0x00) {
+            return nullptr;
+        }
+
+        // otherwise, read next component coefficient
+        byte numZeroes = symbol >> 4;
+        byte coeffLength = symbol & 0x0F;
+        coeff = 0;
+
+        // symbol 0xF0 means skip 16 0's
+        if (symbol == 0xF0) {
+            numZeroes = 16;
+        }
+
+        if (i + numZeroes >= 64) {
+            return "Zero run-length exceeded MCU";
+        }
+        // MCUs start out zeroed, so the run only moves the position
+        i += numZeroes;
+
+        if (coeffLength > 10) {
+            return "AC coefficient length greater than 10";
+        }
+        if (coeffLength != 0) {
+            coeff = b.readBits(coeffLength);
+            if (coeff == -1) {
+                return "Invalid AC value";
+            }
+            if (coeff < (1 << (coeffLength - 1))) {
+                coeff -= (1 << coeffLength) - 1;
+            }
+            component[zigZagMap[i]] = coeff;
+            endOfBlock = i;
+            nonzeroRows |= 1 << (zigZagMap[i] / 8);
+            i += 1;
+        }
+    }
+    return nullptr;
+}
+
+bool decodeMCUComponent(BitReader& b, int* const component, int& previousDC, const HuffmanTable& dcTable,
+        const HuffmanTable& acTable, byte& endOfBlock, byte& nonzeroRows) {
+    const char* error = decodeBlock(b, component, dcTable, acTable, endOfBlock, nonzeroRows);
+    if (error != nullptr) {
+        std::cout << "Error - " << error << "\n";
+        return false;
+    }
+    component[0] += previousDC;
+    previousDC = component[0];
+    if (component[0] != 0) {
+        nonzeroRows |= 1;
+    }
+    return true;
+}
+
+// which component and which of its blocks each block of an MCU is, in scan order
+struct MCULayout {
+    uint numOfUnits = 0;
+    uint component[6];
+    uint v[6];
+    uint h[6];
+    // equivalent[a][b] is true if decoding from unit a uses the same huffman tables
+    // as decoding from unit b for every following block, so both read the same bits
+    bool equivalent[6][6];
+};
+
+MCULayout makeMCULayout(const Header* const header) {
+    MCULayout layout;
+    for (uint i = 0; i < header->numOfComponents; i++) {
+        const ColorComponent& component = header->colorComponents[i];
+        for (uint v = 0; v < component.verticalSamplingFactor; v++) {
+            for (uint h = 0; h < component.horizontalSamplingFactor; h++) {
+                layout.component[layout.numOfUnits] = i;
+                layout.v[layout.numOfUnits] = v;
+                layout.h[layout.numOfUnits] = h;
+                layout.numOfUnits += 1;
+            }
+        }
+    }
+    for (uint a = 0; a < layout.numOfUnits; a++) {
+        for (uint b = 0; b < layout.numOfUnits; b++) {
+            layout.equivalent[a][b] = true;
+            for (uint i = 0; i < layout.numOfUnits; i++) {
+                const ColorComponent& first = header->colorComponents[layout.component[(a + i) % layout.numOfUnits]];
+                const ColorComponent& second = header->colorComponents[layout.component[(b + i) % layout.numOfUnits]];
+                if (first.huffmanDCTableID != second.huffmanDCTableID || first.huffmanACTableID != second.huffmanACTableID) {
+                    layout.equivalent[a][b] = false;
+                }
+            }
+        }
+    }
+    return layout;
+}
 
-    // generate codes for huffman tables
+// the MCU that holds the n-th block of the scan
+MCU& scanBlockMCU(const Header* const header, const MCULayout& layout, MCU* const mcus, const std::size_t n) {
+    const std::size_t mcuIndex = n / layout.numOfUnits;
+    const uint unit = n % layout.numOfUnits;
+    const uint mcuColumns = header->mcuWidthReal / header->horizontalSamplingFactor;
+    const uint y = (mcuIndex / mcuColumns) * header->verticalSamplingFactor + layout.v[unit];
+    const uint x = (mcuIndex % mcuColumns) * header->horizontalSamplingFactor + layout.h[unit];
+    return mcus[y * header->mcuWidthReal + x];
+}
+
+// a block decoded speculatively, where it belongs is only known after the fix-up. Its coefficients
+// up to endOfBlock are kept in zigzag order in the coefficients of its chunk, which is far less than
+// a whole block for most blocks. Baseline coefficients have at most 11 bits.
+struct SpeculativeBlock {
+    uint firstCoefficient;
+    byte endOfBlock;
+    byte nonzeroRows;
+};
+
+// decoder state at the start of a speculative block
+struct SyncPoint {
+    std::size_t bitPosition;
+    uint unit;              // index of the block inside its MCU
+    uint segment;
+};
+
+// blocks decoded one after another from one assumed starting state without an error
+struct Segment {
+    uint firstBlock;
+    uint endBlock;
+    std::size_t endBitPosition;
+};
+
+struct SpeculativeChunk {
+    std::size_t startBit;
+    std::size_t endBit;
+    std::vector<SpeculativeBlock> blocks;
+    std::vector<short> coefficients;
+    std::vector<SyncPoint> points;    // one per block, sorted by bit position
+    std::vector<Segment> segments;
+};
+
+// Decode a chunk as if it started with the first block of an MCU. Huffman codes synchronise
+// by themselves, so after a few blocks of garbage the decoded blocks are usually the real ones.
+// When garbage hits an invalid code, start over one bit further on.
+void decodeChunkSpeculatively(const Header* const header, const MCULayout& layout, SpeculativeChunk& chunk) {
+    BitReader b(header->huffmanData);
+    // blocks are decoded here and then packed, decodeBlock() needs it zeroed
+    int coefficients[64] = { 0 };
+    std::size_t start = chunk.startBit;
+    while (start < chunk.endBit) {
+        Segment segment;
+        segment.firstBlock = chunk.blocks.size();
+        uint unit = 0;
+        bool clean = true;
+        b.seek(start);
+
+        std::size_t position = b.position();
+        while (position < chunk.endBit) {
+            const SyncPoint point = { position, unit, (uint)chunk.segments.size() };
+            SpeculativeBlock block;
+            block.firstCoefficient = chunk.coefficients.size();
+            const ColorComponent& component = header->colorComponents[layout.component[unit]];
+            const char* const error = decodeBlock(b, coefficients, header->huffmanDCTables[component.huffmanDCTableID],
+                    header->huffmanACTables[component.huffmanACTableID], block.endOfBlock, block.nonzeroRows);
+            for (uint i = 0; i <= block.endOfBlock; i++) {
+                if (error == nullptr) {
+                    chunk.coefficients.push_back(coefficients[zigZagMap[i]]);
+                }
+                coefficients[zigZagMap[i]] = 0;
+            }
+            if (error != nullptr) {
+                clean = false;
+                break;
+            }
+            chunk.blocks.push_back(block);
+            chunk.points.push_back(point);
+            unit = (unit + 1) % layout.numOfUnits;
+            position = b.position();
+        }
+
+        segment.endBlock = chunk.blocks.size();
+        segment.endBitPosition = position;
+        if (segment.endBlock != segment.firstBlock) {
+            chunk.segments.push_back(segment);
+        }
+        if (clean) {
+            return;
+        }
+        start = position + 1;
+    }
+}
+
+// blocks of a chunk which turned out to be real, and where they go
+struct AdoptedRange {
+    const SpeculativeChunk* chunk;
+    uint firstBlock;
+    uint numOfBlocks;
+    std::size_t scanBlock;
+};
+
+void copyAdoptedRange(const Header* const header, const MCULayout& layout, MCU* const mcus, const AdoptedRange& range) {
+    for (uint i = 0; i < range.numOfBlocks; i++) {
+        const SpeculativeBlock& block = range.chunk->blocks[range.firstBlock + i];
+        const short* const coefficients = range.chunk->coefficients.data() + block.firstCoefficient;
+        const std::size_t n = range.scanBlock + i;
+        const uint componentIndex = layout.component[n % layout.numOfUnits];
+        MCU& mcu = scanBlockMCU(header, layout, mcus, n);
+        for (uint j = 0; j <= block.endOfBlock; j++) {
+            mcu[componentIndex][zigZagMap[j]] = coefficients[j];
+        }
+        mcu.endOfBlock[componentIndex] = block.endOfBlock;
+        mcu.nonzeroRows[componentIndex] = block.nonzeroRows;
+    }
+}
+
+// find the speculative block which starts at bitPosition and decodes the same way as unit
+bool findSyncPoint(const std::vector<SpeculativeChunk>& chunks, const MCULayout& layout, const std::size_t bitPosition,
+        const uint unit, uint& chunkIndex, uint& blockIndex) {
+    for (chunkIndex = 0; chunkIndex + 1 < chunks.size() && chunks[chunkIndex + 1].startBit <= bitPosition; chunkIndex++);
+    const std::vector<SyncPoint>& points = chunks[chunkIndex].points;
+    const auto it = std::lower_bound(points.begin(), points.end(), bitPosition,
+            [](const SyncPoint& point, const std::size_t position) { return point.bitPosition < position; });
+    if (it == points.end() || it->bitPosition != bitPosition || !layout.equivalent[it->unit][unit]) {
+        return false;
+    }
+    blockIndex = it - points.begin();
+    return true;
+}
+
+// the blocks hold DC differences, add up the differences of each component in scan order.
+// Every thread sums a slice of the scan, then adds the sums of the slices before it to its slice.
+void accumulateDCs(const Header* const header, const MCULayout& layout, MCU* const mcus, const std::size_t numOfBlocks,
+        const uint numOfThreads) {
+    std::vector<int> sums(numOfThreads * 3, 0);
+    std::vector<std::thread> workers;
+    for (uint t = 0; t < numOfThreads; t++) {
+        workers.emplace_back([&, t]() {
+            for (std::size_t n = numOfBlocks * t / numOfThreads; n < numOfBlocks * (t + 1) / numOfThreads; n++) {
+                const uint componentIndex = layout.component[n % layout.numOfUnits];
+                sums[t * 3 + componentIndex] += scanBlockMCU(header, layout, mcus, n)[componentIndex][0];
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+
+    for (uint t = 0; t < numOfThreads; t++) {
+        workers.emplace_back([&, t]() {
+            int previousDCs[3] = { 0 };
+            for (uint i = 0; i < t; i++) {
+                previousDCs[0] += sums[i * 3 + 0];
+                previousDCs[1] += sums[i * 3 + 1];
+                previousDCs[2] += sums[i * 3 + 2];
+            }
+            for (std::size_t n = numOfBlocks * t / numOfThreads; n < numOfBlocks * (t + 1) / numOfThreads; n++) {
+                const uint componentIndex = layout.component[n % layout.numOfUnits];
+                MCU& mcu = scanBlockMCU(header, layout, mcus, n);
+                previousDCs[componentIndex] += mcu[componentIndex][0];
+                mcu[componentIndex][0] = previousDCs[componentIndex];
+                if (previousDCs[componentIndex] != 0) {
+                    mcu.nonzeroRows[componentIndex] |= 1;
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// Scans without restart markers can only be decoded in order, so decode numOfThreads chunks of the
+// scan speculatively in parallel, then walk the scan in order: wherever the real decoder state
+// matches a speculative block, that block and the rest of its segment are taken over, everything
+// else is decoded again. Finally the adopted blocks are copied into place and the DC differences
+// are added up, both in parallel.
+bool decodeHuffmanDataParallel(const Header* const header, MCU* const mcus, const uint numOfThreads) {
+    const MCULayout layout = makeMCULayout(header);
+    const std::size_t numOfBlocks = (std::size_t)(header->mcuHeightReal / header->verticalSamplingFactor) *
+            (header->mcuWidthReal / header->horizontalSamplingFactor) * layout.numOfUnits;
+    const std::size_t numOfBits = header->huffmanData.size() * 8;
+
+    std::vector<SpeculativeChunk> chunks(numOfThreads);
+    for (uint i = 0; i < numOfThreads; i++) {
+        chunks[i].startBit = numOfBits / numOfThreads * i;
+        chunks[i].endBit = (i + 1 == numOfThreads) ? numOfBits : numOfBits / numOfThreads * (i + 1);
+        chunks[i].blocks.reserve(numOfBlocks / numOfThreads + numOfBlocks / 16);
+    }
+
+    std::vector<std::thread> workers;
+    for (uint i = 0; i < numOfThreads; i++) {
+        workers.emplace_back(decodeChunkSpeculatively, header, std::cref(layout), std::ref(chunks[i]));
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+
+    // fix-up walk over the scan
+    std::vector<AdoptedRange> ranges;
+    BitReader b(header->huffmanData);
+    std::size_t n = 0;
+    while (n < numOfBlocks) {
+        const uint unit = n % layout.numOfUnits;
+        uint chunkIndex, blockIndex;
+        if (findSyncPoint(chunks, layout, b.position(), unit, chunkIndex, blockIndex)) {
+            const SpeculativeChunk& chunk = chunks[chunkIndex];
+            const Segment& segment = chunk.segments[chunk.points[blockIndex].segment];
+            const uint count = std::min<std::size_t>(segment.endBlock - blockIndex, numOfBlocks - n);
+            const AdoptedRange range = { &chunk, blockIndex, count, n };
+            ranges.push_back(range);
+            b.seek(blockIndex + count == segment.endBlock ? segment.endBitPosition :
+                    chunk.points[blockIndex + count].bitPosition);
+            n += count;
+            continue;
+        }
+
+        const uint componentIndex = layout.component[unit];
+        const ColorComponent& component = header->colorComponents[componentIndex];
+        MCU& mcu = scanBlockMCU(header, layout, mcus, n);
+        const char* error = decodeBlock(b, mcu[componentIndex], header->huffmanDCTables[component.huffmanDCTableID],
+                header->huffmanACTables[component.huffmanACTableID], mcu.endOfBlock[componentIndex],
+                mcu.nonzeroRows[componentIndex]);
+        if (error != nullptr) {
+            std::cout << "Error - " << error << "\n";
+            return false;
+        }
+        n += 1;
+    }
+
+    for (uint t = 0; t < numOfThreads; t++) {
+        workers.emplace_back([&, t]() {
+            for (std::size_t i = t; i < ranges.size(); i += numOfThreads) {
+                copyAdoptedRange(header, layout, mcus, ranges[i]);
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    accumulateDCs(header, layout, mcus, numOfBlocks, numOfThreads);
+    return true;
+}
+
+void generateCodes(Header* const header) {
     for (int i = 0; i < 4; i++) {
-        if (header->huffmanDCTables[i].set) {
+        if (header->huffmanDCTables[i].set && !header->huffmanDCTables[i].built) {
             generateCodes(header->huffmanDCTables[i]);
         }
+        if (header->huffmanACTables[i].set && !header->huffmanACTables[i].built) {
+            generateCodes(header->huffmanACTables[i]);
+        }
+    }
+}
+
+// decode into mcus which must hold mcuHeightReal * mcuWidthReal zeroed MCUs, scans without
+// restart intervals are split between numOfThreads threads if they are large enough
+bool decodeHuffmanData(Header* const header, MCU* const mcus, uint numOfThreads = 1) {
+    generateCodes(header);
+
+    // below this many bytes per thread the threads cost more than they save
+    const std::size_t minimumChunkSize = 1 << 16;
+    numOfThreads = std::min<std::size_t>(numOfThreads, header->huffmanData.size() / minimumChunkSize);
+    if (header->restartInterval == 0 && numOfThreads > 1) {
+        return decodeHuffmanDataParallel(header, mcus, numOfThreads);
     }
 
+    BitReader b(header->huffmanData);
+    int previousDCs[3] = { 0 };
+    uint mcuCount = 0;
+
+    for (uint y = 0; y < header->mcuHeight; y += header->verticalSamplingFactor) {
+        for (uint x = 0; x < header->mcuWidth; x += header->horizontalSamplingFactor) {
+            if (header->restartInterval != 0 && mcuCount != 0 && mcuCount % header->restartInterval == 0) {
+                previousDCs[0] = 0;
+                previousDCs[1] = 0;
+                previousDCs[2] = 0;
+                b.align();
+            }
+            mcuCount += 1;
+
+            for (uint i = 0; i < header->numOfComponents; i++) {
+                const ColorComponent& component = header->colorComponents[i];
+                for (uint v = 0; v < component.verticalSamplingFactor; v++) {
+                    for (uint h = 0; h < component.horizontalSamplingFactor; h++) {
+                        MCU& mcu = mcus[(y + v) * header->mcuWidthReal + (x + h)];
+                        if (!decodeMCUComponent(b, mcu[i], previousDCs[i],
+                                header->huffmanDCTables[component.huffmanDCTableID],
+                                header->huffmanACTables[component.huffmanACTableID],
+                                mcu.endOfBlock[i], mcu.nonzeroRows[i])) {
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+MCU* decodeHuffmanData(Header* const header, Arena& arena, const uint numOfThreads = 1) {
+    MCU* mcus = arena.allocate<MCU>(header->mcuHeightReal * header->mcuWidthReal);
+    if (mcus == nullptr) {
+        std::cout << "Error - memory error.\n";
+        return nullptr;
+    }
+
+    if (!decodeHuffmanData(header, mcus, numOfThreads)) {
+        return nullptr;
+    }
     return mcus;
 }
 
+// dequantize only up to the last nonzero coefficient, the rest is 0 anyway
+void dequantizeMCUComponent(const QuantizationTable& qTable, int* const component, const byte endOfBlock) {
+    for (uint i = 0; i <= endOfBlock; i++) {
+        component[zigZagMap[i]] *= qTable.table[zigZagMap[i]];
+    }
+}
+
+void dequantize(const Header* const header, MCU* const mcus) {
+    for (uint y = 0; y < header->mcuHeight; y += header->verticalSamplingFactor) {
+        for (uint x = 0; x < header->mcuWidth; x += header->horizontalSamplingFactor) {
+            for (uint i = 0; i < header->numOfComponents; i++) {
+                const ColorComponent& component = header->colorComponents[i];
+                for (uint v = 0; v < component.verticalSamplingFactor; v++) {
+                    for (uint h = 0; h < component.horizontalSamplingFactor; h++) {
+                        MCU& mcu = mcus[(y + v) * header->mcuWidthReal + (x + h)];
+                        dequantizeMCUComponent(header->quantizationTables[component.quantizationTableID], mcu[i],
+                                mcu.endOfBlock[i]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void inverseDCTMCUComponent(int* const component, const byte endOfBlock, const byte nonzeroRows) {
+    if (endOfBlock == 0) {
+        inverseDCTDCOnly(component);
+    } else if (endOfBlock < 10) {
+        // zigzag indexes 0 to 9 all lie in the top left 4x4 corner
+        kernels->inverseDCT4x4(component);
+    } else {
+        kernels->inverseDCTFull(component, nonzeroRows);
+    }
+}
+
+void inverseDCT(const Header* const header, MCU* const mcus) {
+    for (uint y = 0; y < header->mcuHeight; y += header->verticalSamplingFactor) {
+        for (uint x = 0; x < header->mcuWidth; x += header->horizontalSamplingFactor) {
+            for (uint i = 0; i < header->numOfComponents; i++) {
+                const ColorComponent& component = header->colorComponents[i];
+                for (uint v = 0; v < component.verticalSamplingFactor; v++) {
+                    for (uint h = 0; h < component.horizontalSamplingFactor; h++) {
+                        MCU& mcu = mcus[(y + v) * header->mcuWidthReal + (x + h)];
+                        inverseDCTMCUComponent(mcu[i], mcu.endOfBlock[i], mcu.nonzeroRows[i]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// convert one luminance block of an MCU, the chroma values come from the
+// top left block of the MCU which covers the whole MCU at lower resolution
+void YCbCrToRGBMCU(const Header* const header, MCU& yMCU, const MCU& cbcrMCU, const uint v, const uint h) {
+    // without subsampling the kernel reads each chroma value before writing over it
+    if (header->horizontalSamplingFactor == 1 && header->verticalSamplingFactor == 1) {
+        kernels->YCbCrToRGB(yMCU.y, cbcrMCU.cb, cbcrMCU.cr, yMCU.g, yMCU.b);
+        return;
+    }
+
+    int cb[64];
+    int cr[64];
+    kernels->upsample(cbcrMCU.cb, cb, header->horizontalSamplingFactor, header->verticalSamplingFactor, v, h);
+    kernels->upsample(cbcrMCU.cr, cr, header->horizontalSamplingFactor, header->verticalSamplingFactor, v, h);
+    kernels->YCbCrToRGB(yMCU.y, cb, cr, yMCU.g, yMCU.b);
+}
+
+void YCbCrToRGB(const Header* const header, MCU* const mcus) {
+    for (uint y = 0; y < header->mcuHeight; y += header->verticalSamplingFactor) {
+        for (uint x = 0; x < header->mcuWidth; x += header->horizontalSamplingFactor) {
+            const MCU& cbcrMCU = mcus[y * header->mcuWidthReal + x];
+            // the top left block holds the chroma of the whole MCU, convert it last
+            for (int v = header->verticalSamplingFactor - 1; v >= 0; v--) {
+                for (int h = header->horizontalSamplingFactor - 1; h >= 0; h--) {
+                    MCU& yMCU = mcus[(y + v) * header->mcuWidthReal + (x + h)];
+                    YCbCrToRGBMCU(header, yMCU, cbcrMCU, v, h);
+                }
+            }
+        }
+    }
+}
+
+const uint bmpHeaderSize = 26;
+
 // little endian
-void putInt(std::ofstream& outFile, const int v) {
-    outFile.put((v >> 0) & 0xFF);
-    outFile.put((v >> 8) & 0xFF);
-    outFile.put((v >> 16) & 0xFF);
-    outFile.put((v >> 24) & 0xFF);
+void putInt(byte* const out, const int v) {
+    out[0] = (v >> 0) & 0xFF;
+    out[1] = (v >> 8) & 0xFF;
+    out[2] = (v >> 16) & 0xFF;
+    out[3] = (v >> 24) & 0xFF;
 }
 
 // little endian
-void putShort(std::ofstream& outFile, const int v) {
-    outFile.put((v >> 0) & 0xFF);
-    outFile.put((v >> 8) & 0xFF);
+void putShort(byte* const out, const int v) {
+    out[0] = (v >> 0) & 0xFF;
+    out[1] = (v >> 8) & 0xFF;
+}
+
+void writeBMPHeader(byte* const out, const uint width, const uint height) {
+    const int paddingSize = width % 4;
+    const int size = 12 + 14 + (height * width) * 3 + paddingSize * height;
+
+    out[0] = 'B';
+    out[1] = 'M';
+
+    putInt(out + 2, size);
+    putInt(out + 6, 0);
+    putInt(out + 10, 0x1A);
+
+    putInt(out + 14, 12);
+    putShort(out + 18, width);
+    putShort(out + 20, height);
+    putShort(out + 22, 1);  // planes
+    putShort(out + 24, 24); // bits per pixel
+}
+
+void writeBMPHeader(std::ostream& outFile, const uint width, const uint height) {
+    byte header[bmpHeaderSize];
+    writeBMPHeader(header, width, height);
+    outFile.write((const char*)header, bmpHeaderSize);
 }
 
 void writeBMP(const Header* const header, const MCU* const mcus, const std::string& filename) {
@@ -619,32 +1408,17 @@ void writeBMP(const Header* const header, const MCU* const mcus, const std::stri
         return;
     }
 
-    const int mcuHeight = (header->height + 7) / 8;
-    const int mcuWidth = (header->width + 7) / 8;
     const int paddingSize = header->width % 4;
-    const int size = 12 + 14 + (header->height * header->width) * 3 + paddingSize * header->height;
-
-    outFile.put('B');
-    outFile.put('M');
-
-    putInt(outFile, size);
-    putInt(outFile, 0);
-    putInt(outFile, 0x1A);
-
-    putInt(outFile, 12);
-    putShort(outFile, header->width);
-    putShort(outFile, header->height);
-    putShort(outFile, 1);   // planes
-    putShort(outFile, 24);  // bits per pixel
+    writeBMPHeader(outFile, header->width, header->height);
 
     for (int y = header->height - 1; y >= 0; y--) {
         const int mcuRow = y / 8;
         const int pixelRow = y % 8;
-        for (int x = 0; x < header->height; x++) {
+        for (int x = 0; x < header->width; x++) {
             const int mcuCol = x / 8;
             const int pixelCol = x % 8;
-            const int mcuIndex = mcuRow * mcuWidth + mcuCol; 
-            const int pixelIndex = pixelRow * 8 + pixelCol; 
+            const int mcuIndex = mcuRow * header->mcuWidthReal + mcuCol;
+            const int pixelIndex = pixelRow * 8 + pixelCol;
             outFile.put(mcus[mcuIndex].b[pixelIndex]);
             outFile.put(mcus[mcuIndex].g[pixelIndex]);
             outFile.put(mcus[mcuIndex].r[pixelIndex]);
@@ -657,43 +1431,459 @@ void writeBMP(const Header* const header, const MCU* const mcus, const std::stri
     outFile.close();
 }
 
+void writeBMP(std::vector<byte>& out, const uint width, const uint height, const byte* const rgb) {
+    const std::size_t paddingSize = width % 4;
+    const std::size_t rowSize = (std::size_t)width * 3 + paddingSize;
+    out.resize(bmpHeaderSize + rowSize * height);
+    writeBMPHeader(out.data(), width, height);
+
+    for (uint y = 0; y < height; y++) {
+        const byte* row = rgb + (std::size_t)(height - 1 - y) * width * 3;
+        byte* bgr = out.data() + bmpHeaderSize + y * rowSize;
+        for (uint x = 0; x < width; x++) {
+            bgr[x * 3 + 0] = row[x * 3 + 2];
+            bgr[x * 3 + 1] = row[x * 3 + 1];
+            bgr[x * 3 + 2] = row[x * 3 + 0];
+        }
+        std::memset(bgr + (std::size_t)width * 3, 0, paddingSize);
+    }
+}
+
+bool startImage(DecoderContext& context) {
+    context.arena.reset();
+    context.mcus = nullptr;
+    context.header = newHeader(context.arena);
+    if (context.header == nullptr) {
+        std::cout << "Error, memory could not be allocated for Header.\n";
+        return false;
+    }
+    return true;
+}
+
+void printArenaStats(const ArenaStats& stats) {
+    std::cout << "Arena: " << (stats.used >> 10) << " KB used, " << (stats.peak >> 10) << " KB peak, "
+        << (stats.capacity >> 10) << " KB held, " << stats.chunkAllocations << " chunks allocated, "
+        << stats.chunkReleases << " released over " << stats.resets << " resets\n";
+}
+
+void warmDecoderContext(DecoderContext& context) {
+    const uint warmMCUs = 128 * 128;
+    context.arena.reserve(sizeof(Header) + (1 << 20) + warmMCUs * sizeof(MCU) + 3 * Arena::alignment);
+    context.input.assign(1 << 20, 0);
+    context.input.clear();
+    context.pixels.assign(warmMCUs * 64 * 3, 0);
+    context.pixels.clear();
+}
+
+bool decodeImageYCbCr(DecoderContext& context) {
+    Header* const header = context.header;
+    context.mcus = context.arena.allocate<MCU>(header->mcuHeightReal * header->mcuWidthReal);
+    if (context.mcus == nullptr) {
+        std::cout << "Error - memory error.\n";
+        return false;
+    }
+    if (!decodeHuffmanData(header, context.mcus, context.huffmanThreads)) {
+        return false;
+    }
+    dequantize(header, context.mcus);
+    inverseDCT(header, context.mcus);
+    return true;
+}
+
+bool decodeImage(DecoderContext& context) {
+    if (!decodeImageYCbCr(context)) {
+        return false;
+    }
+    YCbCrToRGB(context.header, context.mcus);
+    return true;
+}
+
+void extractRGB(const Header* const header, const MCU* const mcus, const uint cropX, const uint cropY,
+        const uint cropWidth, const uint cropHeight, const uint scale, std::vector<byte>& rgb) {
+    const uint width = (cropWidth + scale - 1) / scale;
+    const uint height = (cropHeight + scale - 1) / scale;
+    rgb.resize((std::size_t)width * height * 3);
+
+    for (uint y = 0; y < height; y++) {
+        for (uint x = 0; x < width; x++) {
+            const uint top = cropY + y * scale;
+            const uint left = cropX + x * scale;
+            const uint bottom = std::min(top + scale, cropY + cropHeight);
+            const uint right = std::min(left + scale, cropX + cropWidth);
+            uint r = 0;
+            uint g = 0;
+            uint b = 0;
+            for (uint py = top; py < bottom; py++) {
+                for (uint px = left; px < right; px++) {
+                    const MCU& mcu = mcus[(py / 8) * header->mcuWidthReal + (px / 8)];
+                    const uint pixel = (py % 8) * 8 + (px % 8);
+                    r += mcu.r[pixel];
+                    g += mcu.g[pixel];
+                    b += mcu.b[pixel];
+                }
+            }
+            const uint count = (bottom - top) * (right - left);
+            byte* out = &rgb[((std::size_t)y * width + x) * 3];
+            out[0] = r / count;
+            out[1] = g / count;
+            out[2] = b / count;
+        }
+    }
+}
+
+bool parsePlanarFormat(const std::string& name, PlanarFormat& format) {
+    if (name == "i420") {
+        format = PLANAR_I420;
+    } else if (name == "nv12") {
+        format = PLANAR_NV12;
+    } else if (name == "yuv444") {
+        format = PLANAR_YUV444;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// width and height of the chroma planes of an image, for NV12 in samples of each component
+void chromaPlaneSize(const PlanarFormat format, const uint width, const uint height, uint& chromaWidth,
+        uint& chromaHeight) {
+    const uint subsampling = (format == PLANAR_YUV444) ? 1 : 2;
+    chromaWidth = (width + subsampling - 1) / subsampling;
+    chromaHeight = (height + subsampling - 1) / subsampling;
+}
+
+std::size_t planarSize(const PlanarFormat format, const uint width, const uint height) {
+    uint chromaWidth = 0;
+    uint chromaHeight = 0;
+    chromaPlaneSize(format, width, height, chromaWidth, chromaHeight);
+    return (std::size_t)width * height + 2 * (std::size_t)chromaWidth * chromaHeight;
+}
+
+void packedPlanes(const PlanarFormat format, const uint width, const uint height, byte* const data, Plane* const planes) {
+    uint chromaWidth = 0;
+    uint chromaHeight = 0;
+    chromaPlaneSize(format, width, height, chromaWidth, chromaHeight);
+    planes[0].data = data;
+    planes[0].stride = width;
+    planes[1].data = data + (std::size_t)width * height;
+    planes[1].stride = (format == PLANAR_NV12) ? 2 * chromaWidth : chromaWidth;
+    planes[2].data = planes[1].data + (std::size_t)chromaWidth * chromaHeight;
+    planes[2].stride = chromaWidth;
+}
+
+byte clampSample(const int value) {
+    return std::min(std::max(value + 128, 0), 255);
+}
+
+void writePlanarYCbCr(const Header* const header, const MCU* const mcus, const PlanarFormat format,
+        const Plane* const planes) {
+    for (uint y = 0; y < header->height; y++) {
+        byte* const row = planes[0].data + y * planes[0].stride;
+        const MCU* const mcuRow = mcus + (y / 8) * header->mcuWidthReal;
+        const uint pixelRow = (y % 8) * 8;
+        for (uint x = 0; x < header->width; x++) {
+            row[x] = clampSample(mcuRow[x / 8].y[pixelRow + x % 8]);
+        }
+    }
+
+    uint chromaWidth = 0;
+    uint chromaHeight = 0;
+    chromaPlaneSize(format, header->width, header->height, chromaWidth, chromaHeight);
+    const uint subsampling = (format == PLANAR_YUV444) ? 1 : 2;
+    const uint hSamp = header->horizontalSamplingFactor;
+    const uint vSamp = header->verticalSamplingFactor;
+    for (uint v = 0; v < chromaHeight; v++) {
+        byte* const cbRow = planes[1].data + v * planes[1].stride;
+        byte* const crRow = (format == PLANAR_NV12) ? cbRow + 1 : planes[2].data + v * planes[2].stride;
+        const uint step = (format == PLANAR_NV12) ? 2 : 1;
+        for (uint u = 0; u < chromaWidth; u++) {
+            if (header->numOfComponents == 1) {
+                cbRow[u * step] = 128;
+                crRow[u * step] = 128;
+                continue;
+            }
+
+            // average the chroma of the pixels the sample covers, each pixel has the chroma of its MCU at
+            // (x / hSamp, y / vSamp) so without a change of subsampling this is one chroma value
+            int cb = 0;
+            int cr = 0;
+            uint count = 0;
+            const uint yEnd = std::min(v * subsampling + subsampling, header->height);
+            const uint xEnd = std::min(u * subsampling + subsampling, header->width);
+            for (uint y = v * subsampling; y < yEnd; y++) {
+                const uint chromaY = y / vSamp;
+                const MCU* const mcuRow = mcus + (chromaY / 8) * vSamp * header->mcuWidthReal;
+                for (uint x = u * subsampling; x < xEnd; x++) {
+                    const uint chromaX = x / hSamp;
+                    const MCU& mcu = mcuRow[(chromaX / 8) * hSamp];
+                    const uint pixel = (chromaY % 8) * 8 + chromaX % 8;
+                    cb += mcu.cb[pixel];
+                    cr += mcu.cr[pixel];
+                    count += 1;
+                }
+            }
+            cbRow[u * step] = clampSample(std::lrint(cb / (float)count));
+            crRow[u * step] = clampSample(std::lrint(cr / (float)count));
+        }
+    }
+}
+
+// decode every file into its planes in format, written without padding to a .yuv file next to it
+int writeYUVFiles(const PlanarFormat format, const std::vector<std::string>& filenames, const uint huffmanThreads) {
+    DecoderContext context;
+    context.huffmanThreads = huffmanThreads;
+    int status = 0;
+    for (const std::string& filename : filenames) {
+        std::ifstream inFile = std::ifstream(filename, std::ios::in | std::ios::binary);
+        if (!inFile.is_open()) {
+            std::cout << "Error, input file cannot be opened --" << filename << "--\n";
+            status = 1;
+            continue;
+        }
+        if (!startImage(context)) {
+            return 1;
+        }
+        Header* const header = context.header;
+        readJPG(inFile, header);
+        if (header->valid == false || !decodeImageYCbCr(context)) {
+            std::cout << "Error - could not decode --" << filename << "--";
+            if (!header->valid) {
+                std::cout << ": " << header->error;
+            }
+            std::cout << '\n';
+            status = 1;
+            continue;
+        }
+
+        Plane planes[3];
+        context.pixels.resize(planarSize(format, header->width, header->height));
+        packedPlanes(format, header->width, header->height, context.pixels.data(), planes);
+        writePlanarYCbCr(header, context.mcus, format, planes);
+
+        const std::size_t pos = filename.find_last_of('.');
+        const std::string outFilename = (pos == std::string::npos) ? (filename + ".yuv") : (filename.substr(0, pos) + ".yuv");
+        std::ofstream outFile = std::ofstream(outFilename, std::ios::out | std::ios::binary);
+        if (!outFile.is_open()) {
+            std::cout << "Output file couldn't be opened\n";
+            status = 1;
+            continue;
+        }
+        outFile.write((const char*)context.pixels.data(), context.pixels.size());
+        std::cout << outFilename << ": " << header->width << 'x' << header->height << '\n';
+    }
+    return status;
+}
+
+// Motion-JPEG, complete JPEG images one after the other in one buffer. The buffers and
+// tables of a stream carry over from frame to frame.
+struct StreamDecoder {
+    DecoderContext context;
+    TableCache tables;
+};
+
+// decode the first frame at or after offset and move offset past it. Returns false if no frame
+// is left, valid tells if the frame could be decoded.
+bool decodeNextFrame(StreamDecoder& stream, const byte* const data, const std::size_t size,
+        std::size_t& offset, bool& valid) {
+    // frames can be padded or separated by bytes of the container
+    while (offset + 1 < size && (data[offset] != 0xFF || data[offset + 1] != SOI)) {
+        offset += 1;
+    }
+    if (offset + 1 >= size) {
+        offset = size;
+        return false;
+    }
+
+    if (!startImage(stream.context)) {
+        valid = false;
+        offset = size;
+        return true;
+    }
+    Header* const header = stream.context.header;
+    MemoryBuffer buffer(data + offset, size - offset);
+    std::istream inFile(&buffer);
+    readJPG(inFile, header, &stream.tables);
+    valid = header->valid && decodeImage(stream.context);
+    // a broken frame is only skipped up to its SOI, the next frame may start inside it
+    offset += header->valid ? buffer.consumed() : 2;
+    return true;
+}
+
+// decode every frame of a Motion-JPEG file, writing frames as <prefix><number>.bmp if a prefix is given
+int decodeStream(const std::string& filename, const std::string& outputPrefix, const uint huffmanThreads) {
+    std::ifstream inFile = std::ifstream(filename, std::ios::in | std::ios::binary);
+    if (!inFile.is_open()) {
+        std::cout << "Error, input file cannot be opened --" << filename << "--\n";
+        return 1;
+    }
+    const std::vector<byte> data{std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>()};
+
+    StreamDecoder stream;
+    stream.context.huffmanThreads = huffmanThreads;
+    warmDecoderContext(stream.context);
+
+    uint frames = 0;
+    uint invalidFrames = 0;
+    std::chrono::duration<double> decodeTime(0);
+    std::size_t offset = 0;
+    bool valid = true;
+    while (true) {
+        const auto start = std::chrono::steady_clock::now();
+        const bool found = decodeNextFrame(stream, data.data(), data.size(), offset, valid);
+        decodeTime += std::chrono::steady_clock::now() - start;
+        if (!found) {
+            break;
+        }
+
+        if (!valid) {
+            std::cout << "Error - frame " << frames << " could not be decoded";
+            if (!stream.context.header->valid) {
+                std::cout << ": " << stream.context.header->error;
+            }
+            std::cout << '\n';
+            invalidFrames += 1;
+        } else if (!outputPrefix.empty()) {
+            writeBMP(stream.context.header, stream.context.mcus, outputPrefix + std::to_string(frames) + ".bmp");
+        }
+        frames += 1;
+    }
+
+    std::cout << "Frames: " << frames << " (" << invalidFrames << " invalid)\n";
+    if (frames != 0) {
+        std::cout << "Decoding time per frame: " << (decodeTime.count() * 1000.0 / frames) << " ms\n";
+    }
+    std::cout << "Table segments reused: " << stream.tables.hits << ", read: " << stream.tables.misses << "\n";
+    std::cout << "Frames with standard huffman tables: " << stream.tables.standardTablesUsed << "\n";
+    printArenaStats(stream.context.arena.stats());
+    return (frames != 0 && invalidFrames == 0) ? 0 : 1;
+}
+
 int main(int argc, char** argv) 
 {
+    // the SIMD level can be forced with JPG_SIMD or a leading --simd <level> for testing and benchmarking
+    SIMDLevel simdLevel = detectSIMDLevel();
+    const char* simdName = std::getenv("JPG_SIMD");
+    uint huffmanThreads = 1;
+    // leading options apply to every mode
+    while (argc >= 3) {
+        const std::string option{argv[1]};
+        if (option == "--simd") {
+            simdName = argv[2];
+        } else if (option == "--huffman-threads") {
+            huffmanThreads = std::max(1ul, std::strtoul(argv[2], nullptr, 10));
+        } else if (option == "--arena-limit") {
+            // megabytes every decoder keeps between images
+            defaultHighWaterMark = std::strtoull(argv[2], nullptr, 10) << 20;
+        } else {
+            break;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+    if (simdName != nullptr && !parseSIMDLevel(simdName, simdLevel)) {
+        std::cout << "Error - unknown SIMD level " << simdName << " (scalar, sse2, avx2 or avx512)\n";
+        return 1;
+    }
+    selectKernels(simdLevel);
+    // a forced level can fall back to another one, say which one runs. On stderr so that it stays
+    // out of the output of modes like --bench and --verify
+    if (simdName != nullptr) {
+        std::cerr << "Using " << kernels->name << " kernels\n";
+    }
+
     if (argc < 2) {
         std::cout << "Error, invalid number of arguments\n";
         return 1;
     }
+    if (std::string(argv[1]) == "--serve") {
+        if ((argc != 3 && argc != 5) || (argc == 5 && std::string(argv[3]) != "--threads")) {
+            std::cout << "Usage: " << argv[0] << " --serve <socket path> [--threads <count>]\n";
+            return 1;
+        }
+        uint numOfThreads = 0;
+        if (argc == 5) {
+            numOfThreads = std::strtoul(argv[4], nullptr, 10);
+        }
+        return serve(argv[2], numOfThreads);
+    }
+    if (std::string(argv[1]) == "--verify") {
+        if (argc < 3) {
+            std::cout << "Usage: " << argv[0] << " --verify <files>\n";
+            return 1;
+        }
+        return verifyFiles(std::vector<std::string>(argv + 2, argv + argc));
+    }
+    if (std::string(argv[1]) == "--yuv") {
+        PlanarFormat format = PLANAR_I420;
+        if (argc < 4 || !parsePlanarFormat(argv[2], format)) {
+            std::cout << "Usage: " << argv[0] << " --yuv <i420|nv12|yuv444> <files>\n";
+            return 1;
+        }
+        return writeYUVFiles(format, std::vector<std::string>(argv + 3, argv + argc), huffmanThreads);
+    }
+    if (std::string(argv[1]) == "--mjpeg") {
+        if ((argc != 3 && argc != 5) || (argc == 5 && std::string(argv[3]) != "--output")) {
+            std::cout << "Usage: " << argv[0] << " --mjpeg <file> [--output <prefix>]\n";
+            return 1;
+        }
+        return decodeStream(argv[2], (argc == 5) ? argv[4] : "", huffmanThreads);
+    }
+    if (std::string(argv[1]) == "--bench") {
+        uint maxThreads = 0;
+        uint iterations = 1;
+        std::string csvFilename;
+        std::vector<std::string> filenames;
+        for (int i = 2; i < argc; i++) {
+            const std::string arg{argv[i]};
+            if (arg == "--threads" && i + 1 < argc) {
+                maxThreads = std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--iterations" && i + 1 < argc) {
+                iterations = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+            } else if (arg == "--csv" && i + 1 < argc) {
+                csvFilename = argv[++i];
+            } else {
+                filenames.push_back(arg);
+            }
+        }
+        if (filenames.empty()) {
+            std::cout << "Usage: " << argv[0] << " --bench [--threads <max>] [--iterations <count>] [--csv <file>] <files>\n";
+            return 1;
+        }
+        return benchmark(filenames, maxThreads, iterations, csvFilename, huffmanThreads);
+    }
+    logMarkers = true;
+    Arena arena;
     for (int i = 1; i < argc; i++) {
         const std::string filename{argv[i]};
-        Header* header = readJPG(filename);
+        arena.reset();
+        Header* header = readJPG(filename, arena);
 
         if (header == nullptr) {
             continue;
         }
         else if (header->valid == false) {
             std::cout << "Error - invalid header in --" << filename << "--\n";
-            delete header;
             continue;
         }
 
         printHeader(header);
 
-        // TODO: Decode Huffman Encoded Bitstream
-        MCU* mcus = decodeHuffmanData(header);
+        MCU* mcus = decodeHuffmanData(header, arena, huffmanThreads);
         if (mcus == nullptr) {
-            delete header;
             continue;
         }
 
+        dequantize(header, mcus);
+        inverseDCT(header, mcus);
+        YCbCrToRGB(header, mcus);
+
         // write the BMP file
         const std::size_t pos = filename.find_last_of('.');
         const std::string outFilename = (pos == std::string::npos) ? (filename + ".bmp") : (filename.substr(0, pos) + ".bmp");
 
         writeBMP(header, mcus, outFilename);
-
-
-        delete[] mcus;
-        delete header;
+        printArenaStats(arena.stats());
     }
     return 0;
 }
\ No newline at end of file
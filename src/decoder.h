@@ -0,0 +1,257 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "jpg.h"
+#include "kernels.h"
+
+// read-only stream over bytes which are already in memory
+struct MemoryBuffer : std::streambuf {
+    MemoryBuffer(const byte* data, const std::size_t size) {
+        char* begin = (char*)data;
+        setg(begin, begin, begin + size);
+    }
+
+    // number of bytes read so far
+    std::size_t consumed() const {
+        return gptr() - eback();
+    }
+
+protected:
+    // seeking lets readers ask how much data is left
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode) override {
+        char* const base = (direction == std::ios_base::beg) ? eback() : (direction == std::ios_base::cur) ? gptr() : egptr();
+        if (offset < eback() - base || offset > egptr() - base) {
+            return pos_type(off_type(-1));
+        }
+        setg(eback(), base + offset, egptr());
+        return pos_type(gptr() - eback());
+    }
+
+    pos_type seekpos(pos_type position, std::ios_base::openmode which) override {
+        return seekoff(off_type(position), std::ios_base::beg, which);
+    }
+};
+
+// set a table from the code counts per length and the symbols, as a DHT would
+void setHuffmanTable(HuffmanTable& hTable, const byte* const counts, const byte* const symbols);
+
+// the tables one DQT or DHT segment defines, huffman tables with their codes already generated
+struct CachedTables {
+    std::vector<byte> segment;      // length and payload, to rule out hash collisions
+    std::vector<std::pair<uint, QuantizationTable>> quantizationTables;    // table id, table
+    std::vector<std::pair<uint, HuffmanTable>> huffmanTables;      // table id + 4 for AC tables, table
+};
+
+// tables of earlier images of a stream, frames of Motion-JPEG repeat the same segments in every frame
+struct TableCache {
+    std::unordered_map<unsigned long long, CachedTables> segments;
+    std::vector<byte> segment;      // the segment being read
+    Header scratch;                 // segments which miss the cache are read into it
+
+    HuffmanTable standardDCTables[2];   // luminance and chrominance
+    HuffmanTable standardACTables[2];
+
+    uint hits = 0;
+    uint misses = 0;
+    uint standardTablesUsed = 0;    // images which left out DHT
+
+    TableCache() {
+        setHuffmanTable(standardDCTables[0], standardDCLuminanceCounts, standardDCSymbols);
+        setHuffmanTable(standardDCTables[1], standardDCChrominanceCounts, standardDCSymbols);
+        setHuffmanTable(standardACTables[0], standardACLuminanceCounts, standardACLuminanceSymbols);
+        setHuffmanTable(standardACTables[1], standardACChrominanceCounts, standardACChrominanceSymbols);
+    }
+};
+
+// read the markers of one image from SOI up to and including its SOS. With a cache DQT and DHT
+// segments are looked up in it.
+void readFrameHeader(std::istream& inFile, Header* const header, TableCache* const cache);
+
+// check that the components and the tables they use are supported and defined. With a cache
+// images without DHT get the standard huffman tables, as Motion-JPEG frames expect.
+void validateHeader(Header* const header, TableCache* const cache);
+
+// read one image up to its EOI
+void readJPG(std::istream& inFile, Header* const header, TableCache* const cache = nullptr);
+
+class BitReader {
+private:
+    const byte* data;
+    const std::size_t size;
+    std::size_t nextByte = 0;
+    unsigned long long bitBuffer = 0;   // next bits are kept in the most significant end
+    uint bitCount = 0;
+    bool exhausted = false;             // a read needed more bits than were left
+
+    // load whole bytes into the buffer while there is room for them
+    void refill() {
+        nextByte = kernels->refill(data, size, nextByte, bitBuffer, bitCount);
+    }
+
+public:
+    BitReader(const ArenaVector<byte>& d) :
+        data(d.data()),
+        size(d.size())
+    {}
+
+    // read 1 bit (0 or 1) or return -1 if all bits have already been read
+    int readBit() {
+        if (bitCount == 0) {
+            refill();
+            if (bitCount == 0) {
+                exhausted = true;
+                return -1;
+            }
+        }
+        int bit = bitBuffer >> 63;
+        bitBuffer <<= 1;
+        bitCount -= 1;
+        return bit;
+    }
+
+    // read a variable number of bits, first read bit is the most significant bit
+    // return -1 if fewer than length bits are left
+    int readBits(const uint length) {
+        if (length == 0) {
+            return 0;
+        }
+        uint available = 0;
+        const int bits = peekBits(length, available);
+        if (available < length) {
+            exhausted = true;
+            return -1;
+        }
+        skipBits(length);
+        return bits;
+    }
+
+    // the next length bits (at most 57) without reading them, available is how many of them
+    // the data still has, the bits past its end are 0
+    uint peekBits(const uint length, uint& available) {
+        if (bitCount < length) {
+            refill();
+        }
+        available = bitCount;
+        return bitBuffer >> (64 - length);
+    }
+
+    // read length bits which have been peeked
+    void skipBits(const uint length) {
+        bitBuffer <<= length;
+        bitCount -= length;
+    }
+
+    // advance to the beginning of the next byte, used at restart intervals
+    // since the encoder pads the last byte before a restart marker with 1s
+    void align() {
+        const uint padding = bitCount % 8;
+        bitBuffer <<= padding;
+        bitCount -= padding;
+    }
+
+    // whether a read failed because the data ended, which a failed read does not tell apart
+    // from an invalid code otherwise as it consumes nothing
+    bool ranOut() const {
+        return exhausted;
+    }
+
+    // number of bits read so far
+    std::size_t position() const {
+        return nextByte * 8 - bitCount;
+    }
+
+    // continue reading at any bit of the data
+    void seek(const std::size_t bitPosition) {
+        nextByte = std::min(bitPosition / 8, size);
+        bitBuffer = 0;
+        bitCount = 0;
+        exhausted = false;
+        refill();
+        const uint skip = std::min<std::size_t>(bitPosition % 8, bitCount);
+        bitBuffer <<= skip;
+        bitCount -= skip;
+    }
+};
+
+
+// fill the coefficients of one zeroed 8x8 component block and remember where its nonzero coefficients are
+// so that the inverse DCT can skip the parts of the block which are known to be zero. component[0] gets
+// the difference to the previous DC value and bit 0 of nonzeroRows only covers the AC coefficients.
+// Returns nullptr or what was wrong with the block.
+const char* decodeBlock(BitReader& b, int* const component, const HuffmanTable& dcTable,
+        const HuffmanTable& acTable, byte& endOfBlock, byte& nonzeroRows);
+
+// generate codes for huffman tables which do not come from a TableCache
+void generateCodes(Header* const header);
+
+// buffers a decoding worker keeps between images so that steady state
+// decoding does not allocate or page fault
+struct DecoderContext {
+    Arena arena;                // the header, its huffman data and the MCUs of the current image
+    Header* header = nullptr;
+    MCU* mcus = nullptr;
+    std::vector<byte> input;
+    std::vector<byte> pixels;
+    uint huffmanThreads = 1;    // threads for scans without restart intervals
+};
+
+// forget the previous image of a context and give it an empty header
+bool startImage(DecoderContext& context);
+
+// touch the memory of a context up front, sized for an image of about 1024x1024
+void warmDecoderContext(DecoderContext& context);
+
+// run the decoding stages up to and including the inverse DCT on the header already read into
+// the context, the MCUs are left with YCbCr values centered around 0
+bool decodeImageYCbCr(DecoderContext& context);
+
+// run all decoding stages on the header already read into the context
+bool decodeImage(DecoderContext& context);
+
+// copy the crop rectangle of a decoded image as top-down interleaved RGB,
+// averaging each scale x scale box into one pixel
+void extractRGB(const Header* const header, const MCU* const mcus, const uint cropX, const uint cropY,
+        const uint cropWidth, const uint cropHeight, const uint scale, std::vector<byte>& rgb);
+
+// write top-down interleaved RGB pixels as a bottom-up BGR bitmap into out, which keeps its capacity
+void writeBMP(std::vector<byte>& out, const uint width, const uint height, const byte* const rgb);
+
+// layouts of YCbCr planes, Y is always a full size plane of its own
+enum PlanarFormat {
+    PLANAR_I420,    // Cb and Cr planes of half width and height
+    PLANAR_NV12,    // one plane of half width and height with Cb and Cr interleaved
+    PLANAR_YUV444   // Cb and Cr planes of full size
+};
+
+bool parsePlanarFormat(const std::string& name, PlanarFormat& format);
+
+// memory of one plane owned by the caller, stride is the distance between the starts of two rows in bytes
+struct Plane {
+    byte* data = nullptr;
+    std::size_t stride = 0;
+};
+
+// bytes of all planes of an image stored without padding between rows
+std::size_t planarSize(const PlanarFormat format, const uint width, const uint height);
+
+// planes of an image stored one after the other without padding between rows
+void packedPlanes(const PlanarFormat format, const uint width, const uint height, byte* const data, Plane* const planes);
+
+// write the Y, Cb and Cr planes of an image decoded up to and including the inverse DCT, without
+// converting it to RGB. Chroma samples cover the same pixels as the chroma of the image in I420 and
+// NV12 and are copied as they are, otherwise they are averaged down or repeated up to the size of the format.
+// I420 and YUV444 use planes[0] to planes[2], NV12 uses planes[0] and planes[1].
+void writePlanarYCbCr(const Header* const header, const MCU* const mcus, const PlanarFormat format,
+        const Plane* const planes);
+
+#endif  // DECODER_H
@@ -0,0 +1,646 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "jpg.h"
+
+// Generates deterministic synthetic JPEGs for testing and benchmarking the decoder.
+// Every image is a function of its parameters and the seed only, so the same command
+// line always produces the same corpus.
+
+struct ImageSpec {
+    uint width = 0;
+    uint height = 0;
+    uint numOfComponents = 3;
+    byte horizontalSamplingFactor = 1;  // of the luminance component
+    byte verticalSamplingFactor = 1;
+    std::string samplingName;
+    uint quality = 75;
+    uint restartInterval = 0;   // 0 means never restart
+    bool progressive = false;
+    uint seed = 1;
+};
+
+// standard luminance and chrominance quantization tables in natural order (JPEG Annex K)
+const uint luminanceQuantizationTable[64] = {
+    16, 11, 10, 16,  24,  40,  51,  61,
+    12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,
+    14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,
+    24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103,  99
+};
+
+const uint chrominanceQuantizationTable[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99
+};
+
+// number of codes of each length 1 to 16, the code length distribution of the standard tables
+const byte dcCodeLengthCounts[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const byte acCodeLengthCounts[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 125 };
+
+struct EncoderTable {
+    byte counts[16] = { 0 };
+    byte symbols[162] = { 0 };
+    uint numOfSymbols = 0;
+    uint codes[256] = { 0 };
+    byte lengths[256] = { 0 };
+};
+
+void generateEncoderCodes(EncoderTable& table) {
+    uint code = 0;
+    uint k = 0;
+    for (uint i = 0; i < 16; i++) {
+        for (uint j = 0; j < table.counts[i]; j++, k++) {
+            table.codes[table.symbols[k]] = code;
+            table.lengths[table.symbols[k]] = i + 1;
+            code += 1;
+        }
+        code <<= 1;
+    }
+}
+
+EncoderTable makeDCTable() {
+    EncoderTable table;
+    for (uint i = 0; i < 16; i++) {
+        table.counts[i] = dcCodeLengthCounts[i];
+    }
+    for (uint i = 0; i < 12; i++) {
+        table.symbols[i] = i;
+    }
+    table.numOfSymbols = 12;
+    generateEncoderCodes(table);
+    return table;
+}
+
+// every run/size symbol gets a code, shorter runs and sizes get the shorter codes
+EncoderTable makeACTable() {
+    EncoderTable table;
+    for (uint i = 0; i < 16; i++) {
+        table.counts[i] = acCodeLengthCounts[i];
+    }
+    table.symbols[table.numOfSymbols++] = 0x00;    // end of block
+    for (uint rank = 1; rank <= 25; rank++) {
+        for (uint run = 0; run < 16; run++) {
+            const int size = (int)rank - (int)run;
+            if (size >= 1 && size <= 10) {
+                table.symbols[table.numOfSymbols++] = (run << 4) | size;
+            }
+        }
+        if (rank == 15) {
+            table.symbols[table.numOfSymbols++] = 0xF0;    // 16 zeroes
+        }
+    }
+    generateEncoderCodes(table);
+    return table;
+}
+
+class BitWriter {
+private:
+    std::ostream& outFile;
+    uint bitBuffer = 0;
+    uint bitCount = 0;
+
+public:
+    BitWriter(std::ostream& out) :
+        outFile(out)
+    {}
+
+    void writeBits(const uint bits, const uint length) {
+        for (int i = length - 1; i >= 0; i--) {
+            bitBuffer = (bitBuffer << 1) | ((bits >> i) & 1);
+            bitCount += 1;
+            if (bitCount == 8) {
+                outFile.put(bitBuffer);
+                // an actual 0xFF is followed by 0x00 so it is not read as a marker
+                if (bitBuffer == 0xFF) {
+                    outFile.put(0);
+                }
+                bitBuffer = 0;
+                bitCount = 0;
+            }
+        }
+    }
+
+    // pad the last byte with 1s
+    void flush() {
+        while (bitCount != 0) {
+            writeBits(1, 1);
+        }
+    }
+};
+
+uint hashCoordinates(const uint x, const uint y, const uint seed) {
+    uint h = x * 0x9E3779B1u ^ y * 0x85EBCA77u ^ seed * 0xC2B2AE3Du;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return h;
+}
+
+// the image is made of 128x128 tiles which are flat, gradients, rings or noise,
+// so every image has both nearly empty and dense blocks
+void samplePixel(const ImageSpec& spec, uint x, uint y, int& r, int& g, int& b) {
+    if (x >= spec.width) x = spec.width - 1;
+    if (y >= spec.height) y = spec.height - 1;
+
+    const uint tile = hashCoordinates(x >> 7, y >> 7, spec.seed);
+    const int baseR = tile & 0xFF;
+    const int baseG = (tile >> 8) & 0xFF;
+    const int baseB = (tile >> 16) & 0xFF;
+    const int tx = x & 0x7F;
+    const int ty = y & 0x7F;
+    switch (tile >> 30) {
+        case 0:
+            r = baseR;
+            g = baseG;
+            b = baseB;
+            break;
+        case 1:
+            r = (baseR + tx) & 0xFF;
+            g = (baseG + ty) & 0xFF;
+            b = (baseB + (tx + ty) / 2) & 0xFF;
+            break;
+        case 2: {
+            const int ring = ((tx - 64) * (tx - 64) + (ty - 64) * (ty - 64)) >> 4;
+            r = (baseR + ring) & 0xFF;
+            g = (baseG + ring * 2) & 0xFF;
+            b = (ring & 0x10) ? baseB : 255 - baseB;
+            break;
+        }
+        default: {
+            const uint noise = hashCoordinates(x, y, spec.seed);
+            r = (baseR + (noise & 0x3F)) & 0xFF;
+            g = (baseG + ((noise >> 8) & 0x3F)) & 0xFF;
+            b = (baseB + ((noise >> 16) & 0x3F)) & 0xFF;
+            break;
+        }
+    }
+}
+
+float componentValue(const uint component, const int r, const int g, const int b) {
+    switch (component) {
+        case 0:
+            return 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+        case 1:
+            return -0.1687f * r - 0.3313f * g + 0.5f * b;
+        default:
+            return 0.5f * r - 0.4187f * g - 0.0813f * b;
+    }
+}
+
+// fdctMap[u][x] = C(u) * cos((2x + 1) * u * pi / 16) / 2
+struct FDCTMap {
+    float m[8][8];
+
+    FDCTMap() {
+        const float pi = 3.14159265358979f;
+        for (uint u = 0; u < 8; u++) {
+            const float c = (u == 0) ? (1.0f / std::sqrt(2.0f)) : 1.0f;
+            for (uint x = 0; x < 8; x++) {
+                m[u][x] = c * std::cos((2.0f * x + 1.0f) * u * pi / 16.0f) / 2.0f;
+            }
+        }
+    }
+};
+
+const FDCTMap fdctMap;
+
+struct QuantizationTables {
+    uint table[2][64];
+};
+
+QuantizationTables makeQuantizationTables(const uint quality) {
+    // same quality scaling as the IJG library
+    const uint scale = (quality < 50) ? (5000 / quality) : (200 - quality * 2);
+    QuantizationTables tables;
+    for (uint i = 0; i < 64; i++) {
+        uint luminance = (luminanceQuantizationTable[i] * scale + 50) / 100;
+        uint chrominance = (chrominanceQuantizationTable[i] * scale + 50) / 100;
+        tables.table[0][i] = std::min(255u, std::max(1u, luminance));
+        tables.table[1][i] = std::min(255u, std::max(1u, chrominance));
+    }
+    return tables;
+}
+
+// compute the quantized coefficients of one block of a component in natural order,
+// blockX and blockY count blocks in the component's own resolution
+void computeBlock(const ImageSpec& spec, const QuantizationTables& tables, const uint component,
+        const uint blockX, const uint blockY, int* const coefficients) {
+    const uint hStep = (component == 0) ? 1 : spec.horizontalSamplingFactor;
+    const uint vStep = (component == 0) ? 1 : spec.verticalSamplingFactor;
+
+    float samples[64];
+    for (uint y = 0; y < 8; y++) {
+        for (uint x = 0; x < 8; x++) {
+            float sum = 0.0f;
+            for (uint v = 0; v < vStep; v++) {
+                for (uint h = 0; h < hStep; h++) {
+                    int r, g, b;
+                    samplePixel(spec, ((blockX * 8 + x) * hStep) + h, ((blockY * 8 + y) * vStep) + v, r, g, b);
+                    sum += componentValue(component, r, g, b);
+                }
+            }
+            samples[y * 8 + x] = sum / (hStep * vStep);
+        }
+    }
+
+    float temp[64];
+    for (uint v = 0; v < 8; v++) {
+        for (uint x = 0; x < 8; x++) {
+            float sum = 0.0f;
+            for (uint y = 0; y < 8; y++) {
+                sum += fdctMap.m[v][y] * samples[y * 8 + x];
+            }
+            temp[v * 8 + x] = sum;
+        }
+    }
+    const uint* const qTable = tables.table[component == 0 ? 0 : 1];
+    for (uint v = 0; v < 8; v++) {
+        for (uint u = 0; u < 8; u++) {
+            float sum = 0.0f;
+            for (uint x = 0; x < 8; x++) {
+                sum += fdctMap.m[u][x] * temp[v * 8 + x];
+            }
+            // baseline allows at most 10 bits for AC coefficients, DC is within that range anyway
+            coefficients[v * 8 + u] = std::min(1023, std::max(-1023, (int)std::lrint(sum / qTable[v * 8 + u])));
+        }
+    }
+}
+
+// number of bits needed for a coefficient and the bits that represent it
+void coefficientBits(const int coeff, uint& length, uint& bits) {
+    uint magnitude = coeff < 0 ? -coeff : coeff;
+    length = 0;
+    while (magnitude != 0) {
+        length += 1;
+        magnitude >>= 1;
+    }
+    bits = coeff < 0 ? (coeff + (1 << length) - 1) : coeff;
+}
+
+void encodeDC(BitWriter& writer, const EncoderTable& dcTable, const int coeff, int& previousDC) {
+    uint length, bits;
+    coefficientBits(coeff - previousDC, length, bits);
+    previousDC = coeff;
+    writer.writeBits(dcTable.codes[length], dcTable.lengths[length]);
+    writer.writeBits(bits, length);
+}
+
+// encode zigzag coefficients startOfSelection to endOfSelection, for a band of a
+// progressive scan a 0x00 symbol is an end of band run of 1 which codes the same way
+void encodeAC(BitWriter& writer, const EncoderTable& acTable, const int* const coefficients,
+        const uint startOfSelection, const uint endOfSelection) {
+    uint numZeroes = 0;
+    for (uint i = startOfSelection; i <= endOfSelection; i++) {
+        const int coeff = coefficients[zigZagMap[i]];
+        if (coeff == 0) {
+            numZeroes += 1;
+            continue;
+        }
+        while (numZeroes >= 16) {
+            writer.writeBits(acTable.codes[0xF0], acTable.lengths[0xF0]);
+            numZeroes -= 16;
+        }
+        uint length, bits;
+        coefficientBits(coeff, length, bits);
+        const byte symbol = (numZeroes << 4) | length;
+        writer.writeBits(acTable.codes[symbol], acTable.lengths[symbol]);
+        writer.writeBits(bits, length);
+        numZeroes = 0;
+    }
+    if (numZeroes != 0) {
+        writer.writeBits(acTable.codes[0x00], acTable.lengths[0x00]);
+    }
+}
+
+void putShort(std::ostream& outFile, const uint v) {
+    outFile.put((v >> 8) & 0xFF);
+    outFile.put(v & 0xFF);
+}
+
+void writeMarker(std::ostream& outFile, const byte marker) {
+    outFile.put(0xFF);
+    outFile.put(marker);
+}
+
+void writeHeaders(std::ostream& outFile, const ImageSpec& spec, const QuantizationTables& tables,
+        const EncoderTable& dcTable, const EncoderTable& acTable) {
+    writeMarker(outFile, SOI);
+
+    writeMarker(outFile, APP0);
+    putShort(outFile, 16);
+    outFile.write("JFIF", 5);
+    outFile.put(1);     // version 1.01
+    outFile.put(1);
+    outFile.put(0);     // no density units
+    putShort(outFile, 1);
+    putShort(outFile, 1);
+    outFile.put(0);     // no thumbnail
+    outFile.put(0);
+
+    const uint numOfTables = (spec.numOfComponents == 1) ? 1 : 2;
+    writeMarker(outFile, DQT);
+    putShort(outFile, 2 + numOfTables * 65);
+    for (uint t = 0; t < numOfTables; t++) {
+        outFile.put(t);     // 8 bit entries
+        for (uint i = 0; i < 64; i++) {
+            outFile.put(tables.table[t][zigZagMap[i]]);
+        }
+    }
+
+    writeMarker(outFile, spec.progressive ? SOF2 : SOF0);
+    putShort(outFile, 8 + spec.numOfComponents * 3);
+    outFile.put(8);
+    putShort(outFile, spec.height);
+    putShort(outFile, spec.width);
+    outFile.put(spec.numOfComponents);
+    for (uint i = 0; i < spec.numOfComponents; i++) {
+        outFile.put(i + 1);
+        if (i == 0) {
+            outFile.put((spec.horizontalSamplingFactor << 4) | spec.verticalSamplingFactor);
+        } else {
+            outFile.put(0x11);
+        }
+        outFile.put(i == 0 ? 0 : 1);
+    }
+
+    writeMarker(outFile, DHT);
+    putShort(outFile, 2 + 17 + dcTable.numOfSymbols + 17 + acTable.numOfSymbols);
+    outFile.put(0x00);      // DC table 0
+    outFile.write((const char*)dcTable.counts, 16);
+    outFile.write((const char*)dcTable.symbols, dcTable.numOfSymbols);
+    outFile.put(0x10);      // AC table 0
+    outFile.write((const char*)acTable.counts, 16);
+    outFile.write((const char*)acTable.symbols, acTable.numOfSymbols);
+
+    if (spec.restartInterval != 0) {
+        writeMarker(outFile, DRI);
+        putShort(outFile, 4);
+        putShort(outFile, spec.restartInterval);
+    }
+}
+
+void writeScanHeader(std::ostream& outFile, const std::vector<uint>& components, const byte startOfSelection,
+        const byte endOfSelection) {
+    writeMarker(outFile, SOS);
+    putShort(outFile, 6 + components.size() * 2);
+    outFile.put(components.size());
+    for (uint component : components) {
+        outFile.put(component + 1);
+        outFile.put(0x00);  // every component uses DC table 0 and AC table 0
+    }
+    outFile.put(startOfSelection);
+    outFile.put(endOfSelection);
+    outFile.put(0);         // no successive approximation
+}
+
+// between restart intervals pad the bits, write the next RSTn marker and reset the predictions
+void restart(std::ostream& outFile, BitWriter& writer, uint& restartCount, int* const previousDCs) {
+    writer.flush();
+    writeMarker(outFile, RST0 + (restartCount % 8));
+    restartCount += 1;
+    previousDCs[0] = 0;
+    previousDCs[1] = 0;
+    previousDCs[2] = 0;
+}
+
+// interleaved scan over all components in MCU order, either a whole baseline scan or a progressive DC scan
+void writeInterleavedScan(std::ostream& outFile, const ImageSpec& spec, const QuantizationTables& tables,
+        const EncoderTable& dcTable, const EncoderTable& acTable, const bool dcOnly) {
+    std::vector<uint> components;
+    for (uint i = 0; i < spec.numOfComponents; i++) {
+        components.push_back(i);
+    }
+    writeScanHeader(outFile, components, 0, dcOnly ? 0 : 63);
+
+    const uint mcuHeight = (spec.height + 8 * spec.verticalSamplingFactor - 1) / (8 * spec.verticalSamplingFactor);
+    const uint mcuWidth = (spec.width + 8 * spec.horizontalSamplingFactor - 1) / (8 * spec.horizontalSamplingFactor);
+    const uint numOfMCUs = mcuHeight * mcuWidth;
+
+    BitWriter writer(outFile);
+    int previousDCs[3] = { 0 };
+    int coefficients[64];
+    uint restartCount = 0;
+    for (uint mcu = 0; mcu < numOfMCUs; mcu++) {
+        if (spec.restartInterval != 0 && mcu != 0 && mcu % spec.restartInterval == 0) {
+            restart(outFile, writer, restartCount, previousDCs);
+        }
+        const uint mcuY = mcu / mcuWidth;
+        const uint mcuX = mcu % mcuWidth;
+        for (uint i = 0; i < spec.numOfComponents; i++) {
+            const uint vBlocks = (i == 0) ? spec.verticalSamplingFactor : 1;
+            const uint hBlocks = (i == 0) ? spec.horizontalSamplingFactor : 1;
+            for (uint v = 0; v < vBlocks; v++) {
+                for (uint h = 0; h < hBlocks; h++) {
+                    computeBlock(spec, tables, i, mcuX * hBlocks + h, mcuY * vBlocks + v, coefficients);
+                    encodeDC(writer, dcTable, coefficients[0], previousDCs[i]);
+                    if (!dcOnly) {
+                        encodeAC(writer, acTable, coefficients, 1, 63);
+                    }
+                }
+            }
+        }
+    }
+    writer.flush();
+}
+
+// progressive AC band of a single component, non-interleaved scans go over the
+// component's own blocks in raster order and every block is an MCU
+void writeACScan(std::ostream& outFile, const ImageSpec& spec, const QuantizationTables& tables,
+        const EncoderTable& acTable, const uint component, const byte startOfSelection, const byte endOfSelection) {
+    writeScanHeader(outFile, std::vector<uint>(1, component), startOfSelection, endOfSelection);
+
+    const uint hStep = (component == 0) ? 1 : spec.horizontalSamplingFactor;
+    const uint vStep = (component == 0) ? 1 : spec.verticalSamplingFactor;
+    const uint componentWidth = (spec.width + hStep - 1) / hStep;
+    const uint componentHeight = (spec.height + vStep - 1) / vStep;
+    const uint blockWidth = (componentWidth + 7) / 8;
+    const uint blockHeight = (componentHeight + 7) / 8;
+
+    BitWriter writer(outFile);
+    int previousDCs[3] = { 0 };
+    int coefficients[64];
+    uint restartCount = 0;
+    for (uint block = 0; block < blockHeight * blockWidth; block++) {
+        if (spec.restartInterval != 0 && block != 0 && block % spec.restartInterval == 0) {
+            restart(outFile, writer, restartCount, previousDCs);
+        }
+        computeBlock(spec, tables, component, block % blockWidth, block / blockWidth, coefficients);
+        encodeAC(writer, acTable, coefficients, startOfSelection, endOfSelection);
+    }
+    writer.flush();
+}
+
+bool writeJPG(const ImageSpec& spec, const std::string& filename) {
+    std::ofstream outFile = std::ofstream(filename, std::ios::out | std::ios::binary);
+    if (!outFile.is_open()) {
+        std::cout << "Error - output file cannot be opened --" << filename << "--\n";
+        return false;
+    }
+
+    const QuantizationTables tables = makeQuantizationTables(spec.quality);
+    const EncoderTable dcTable = makeDCTable();
+    const EncoderTable acTable = makeACTable();
+
+    writeHeaders(outFile, spec, tables, dcTable, acTable);
+    if (spec.progressive) {
+        // spectral selection only: DC of all components, then two AC bands per component
+        writeInterleavedScan(outFile, spec, tables, dcTable, acTable, true);
+        for (uint i = 0; i < spec.numOfComponents; i++) {
+            writeACScan(outFile, spec, tables, acTable, i, 1, 5);
+            writeACScan(outFile, spec, tables, acTable, i, 6, 63);
+        }
+    } else {
+        writeInterleavedScan(outFile, spec, tables, dcTable, acTable, false);
+    }
+    writeMarker(outFile, EOI);
+
+    outFile.close();
+    return bool(outFile);
+}
+
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+bool parseSampling(const std::string& name, ImageSpec& spec) {
+    spec.samplingName = name;
+    spec.numOfComponents = 3;
+    if (name == "444") {
+        spec.horizontalSamplingFactor = 1;
+        spec.verticalSamplingFactor = 1;
+    } else if (name == "422") {
+        spec.horizontalSamplingFactor = 2;
+        spec.verticalSamplingFactor = 1;
+    } else if (name == "440") {
+        spec.horizontalSamplingFactor = 1;
+        spec.verticalSamplingFactor = 2;
+    } else if (name == "420") {
+        spec.horizontalSamplingFactor = 2;
+        spec.verticalSamplingFactor = 2;
+    } else if (name == "gray") {
+        spec.numOfComponents = 1;
+        spec.horizontalSamplingFactor = 1;
+        spec.verticalSamplingFactor = 1;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " <output directory> [options]\n"
+              << "  --sizes <WxH,...>          default 640x480,1920x1080,4000x3000\n"
+              << "  --sampling <444,422,440,420,gray,...>  default 444,420\n"
+              << "  --quality <1-100,...>      default 75\n"
+              << "  --restart <MCUs,...>       default 0,8 (0 means no restart markers)\n"
+              << "  --progressive <0,1,...>    default 0\n"
+              << "  --seed <n>                 default 1\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc % 2 != 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const std::string directory{argv[1]};
+    std::vector<std::string> sizes = splitList("640x480,1920x1080,4000x3000");
+    std::vector<std::string> samplings = splitList("444,420");
+    std::vector<std::string> qualities = splitList("75");
+    std::vector<std::string> restarts = splitList("0,8");
+    std::vector<std::string> progressives = splitList("0");
+    uint seed = 1;
+
+    for (int i = 2; i < argc; i += 2) {
+        const std::string option{argv[i]};
+        const std::string value{argv[i + 1]};
+        if (option == "--sizes") {
+            sizes = splitList(value);
+        } else if (option == "--sampling") {
+            samplings = splitList(value);
+        } else if (option == "--quality") {
+            qualities = splitList(value);
+        } else if (option == "--restart") {
+            restarts = splitList(value);
+        } else if (option == "--progressive") {
+            progressives = splitList(value);
+        } else if (option == "--seed") {
+            seed = std::strtoul(value.c_str(), nullptr, 10);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    for (const std::string& size : sizes) {
+        for (const std::string& sampling : samplings) {
+            for (const std::string& quality : qualities) {
+                for (const std::string& restartInterval : restarts) {
+                    for (const std::string& progressive : progressives) {
+                        ImageSpec spec;
+                        spec.seed = seed;
+                        if (std::sscanf(size.c_str(), "%ux%u", &spec.width, &spec.height) != 2 ||
+                                spec.width == 0 || spec.height == 0 || spec.width > 65535 || spec.height > 65535) {
+                            std::cout << "Error - invalid size " << size << "\n";
+                            return 1;
+                        }
+                        if (!parseSampling(sampling, spec)) {
+                            std::cout << "Error - invalid sampling " << sampling << "\n";
+                            return 1;
+                        }
+                        spec.quality = std::strtoul(quality.c_str(), nullptr, 10);
+                        if (spec.quality == 0 || spec.quality > 100) {
+                            std::cout << "Error - invalid quality " << quality << "\n";
+                            return 1;
+                        }
+                        spec.restartInterval = std::strtoul(restartInterval.c_str(), nullptr, 10);
+                        if (spec.restartInterval > 65535) {
+                            std::cout << "Error - invalid restart interval " << restartInterval << "\n";
+                            return 1;
+                        }
+                        spec.progressive = (progressive == "1");
+
+                        std::ostringstream filename;
+                        filename << directory << "/synthetic_" << spec.width << "x" << spec.height << "_"
+                                 << spec.samplingName << "_q" << spec.quality << "_r" << spec.restartInterval << "_"
+                                 << (spec.progressive ? "progressive" : "baseline") << ".jpg";
+                        std::cout << "Writing --" << filename.str() << "--\n";
+                        if (!writeJPG(spec, filename.str())) {
+                            std::cout << "Error - could not write --" << filename.str() << "--\n";
+                            return 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
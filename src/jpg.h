@@ -3,6 +3,8 @@
 
 #include <vector>
 
+#include "arena.h"
+
 typedef unsigned char byte;
 typedef unsigned int uint;
 
@@ -97,11 +99,20 @@ struct QuantizationTable {
     bool set = false;
 };
 
+// codes of up to this many bits are decoded with one table lookup
+const uint huffmanLookupBits = 9;
+
 struct HuffmanTable {
     byte offsets[17] = { 0 };
     byte symbols[162] = { 0 };
     uint codes[162] = { 0 };
+
+    // indexed by the next huffmanLookupBits bits, length is 0 if the code is longer
+    byte lookupSymbols[1 << huffmanLookupBits] = { 0 };
+    byte lookupLengths[1 << huffmanLookupBits] = { 0 };
+
     bool set = false;
+    bool built = false;     // codes and lookup are generated from offsets and symbols
 };
 
 struct ColorComponent {
@@ -123,6 +134,11 @@ struct Header {
     uint width = 0;
     uint numOfComponents = 0;
 
+    uint mcuHeight = 0;         // image size in 8x8 blocks
+    uint mcuWidth = 0;
+    uint mcuHeightReal = 0;     // padded up to a multiple of the sampling factors
+    uint mcuWidthReal = 0;
+
     byte startOfSelection = 0;
     byte endOfSelection = 63;
     byte successiveApproximationHigh = 0;
@@ -131,10 +147,13 @@ struct Header {
     uint restartInterval = 0;   // 0 means never restart
 
     ColorComponent colorComponents[3];
+    byte horizontalSamplingFactor = 1;  // sampling factors of the luminance component,
+    byte verticalSamplingFactor = 1;    // i.e. the size of one MCU in 8x8 blocks
     bool zeroBased = false;     // componentID base (default is starts from 1, not 0)
     bool valid = true;
+    char error[128] = "";       // why the header is not valid
 
-    std::vector<byte> huffmanData;
+    ArenaVector<byte> huffmanData;     // in the arena of the header if it has one
 };
 
 struct MCU {
@@ -150,6 +169,23 @@ struct MCU {
         int cr[64] = { 0 };
         int b[64];
     };
+
+    // filled while decoding the huffman data, indexed by component
+    byte endOfBlock[3] = { 0 };     // zigzag index of the last nonzero coefficient
+    byte nonzeroRows[3] = { 0 };    // bit i is set if row i has a nonzero coefficient
+
+    int* operator[](uint i) {
+        switch (i) {
+            case 0:
+                return y;
+            case 1:
+                return cb;
+            case 2:
+                return cr;
+            default:
+                return nullptr;
+        }
+    }
 };
 
 const byte zigZagMap[] = {
@@ -163,4 +199,46 @@ const byte zigZagMap[] = {
     53, 60, 61, 54, 47, 55, 62, 63
 };
 
+// the example huffman tables of Annex K, Motion-JPEG frames without DHT are coded with them.
+// Counts are the number of codes of length 1 to 16.
+const byte standardDCLuminanceCounts[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const byte standardDCChrominanceCounts[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+const byte standardDCSymbols[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+const byte standardACLuminanceCounts[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D };
+const byte standardACLuminanceSymbols[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06,
+    0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08,
+    0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45,
+    0x46, 0x47, 0x48, 0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x73, 0x74, 0x75,
+    0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3,
+    0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6,
+    0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9,
+    0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+    0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4,
+    0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA
+};
+
+const byte standardACChrominanceCounts[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+const byte standardACChrominanceSymbols[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41,
+    0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0, 0x15, 0x62, 0x72, 0xD1,
+    0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+    0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44,
+    0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x73, 0x74,
+    0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A,
+    0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4,
+    0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7,
+    0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+    0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4,
+    0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA
+};
+
 #endif  // JPG_H
\ No newline at end of file
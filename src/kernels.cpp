@@ -0,0 +1,477 @@
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_KERNELS
+#endif
+
+#include "kernels.h"
+
+// All levels do the same float operations in the same order, and the Makefile turns off
+// fused multiply-adds, which avx512f would otherwise allow the compiler to use,
+// so every level produces exactly the same pixels.
+
+// idctMap[u][x] = C(u) * cos((2x + 1) * u * pi / 16) / 2 so that both 1D passes
+// together give the 1/4 * C(u) * C(v) scaling of the 2D inverse DCT
+struct IDCTMap {
+    float m[8][8];
+
+    IDCTMap() {
+        const float pi = 3.14159265358979f;
+        for (uint u = 0; u < 8; u++) {
+            const float c = (u == 0) ? (1.0f / std::sqrt(2.0f)) : 1.0f;
+            for (uint x = 0; x < 8; x++) {
+                m[u][x] = c * std::cos((2.0f * x + 1.0f) * u * pi / 16.0f) / 2.0f;
+            }
+        }
+    }
+};
+
+const IDCTMap idctMap;
+
+void inverseDCTDCOnly(int* const component) {
+    const int value = std::lrint((idctMap.m[0][0] * component[0]) * idctMap.m[0][0]);
+    for (uint i = 0; i < 64; i++) {
+        component[i] = value;
+    }
+}
+
+// scalar ================================================================
+
+// all nonzero coefficients are in the top left 4x4 corner, so only
+// half of the rows and columns contribute to each pass
+void inverseDCT4x4Scalar(int* const component) {
+    float temp[64];
+    for (uint y = 0; y < 8; y++) {
+        for (uint u = 0; u < 4; u++) {
+            float sum = 0.0f;
+            for (uint v = 0; v < 4; v++) {
+                sum += idctMap.m[v][y] * component[v * 8 + u];
+            }
+            temp[y * 8 + u] = sum;
+        }
+    }
+    for (uint y = 0; y < 8; y++) {
+        for (uint x = 0; x < 8; x++) {
+            float sum = 0.0f;
+            for (uint u = 0; u < 4; u++) {
+                sum += idctMap.m[u][x] * temp[y * 8 + u];
+            }
+            component[y * 8 + x] = std::lrint(sum);
+        }
+    }
+}
+
+// separable inverse DCT, columns then rows, rows with only zero coefficients are skipped in the first pass
+void inverseDCTFullScalar(int* const component, const byte nonzeroRows) {
+    float temp[64];
+    for (uint y = 0; y < 8; y++) {
+        for (uint u = 0; u < 8; u++) {
+            float sum = 0.0f;
+            for (uint v = 0; v < 8; v++) {
+                if (nonzeroRows & (1 << v)) {
+                    sum += idctMap.m[v][y] * component[v * 8 + u];
+                }
+            }
+            temp[y * 8 + u] = sum;
+        }
+    }
+    for (uint y = 0; y < 8; y++) {
+        for (uint x = 0; x < 8; x++) {
+            float sum = 0.0f;
+            for (uint u = 0; u < 8; u++) {
+                sum += idctMap.m[u][x] * temp[y * 8 + u];
+            }
+            component[y * 8 + x] = std::lrint(sum);
+        }
+    }
+}
+
+void upsampleScalar(const int* const chroma, int* const out, const uint horizontalSamplingFactor,
+        const uint verticalSamplingFactor, const uint v, const uint h) {
+    for (uint y = 0; y < 8; y++) {
+        for (uint x = 0; x < 8; x++) {
+            const uint chromaRow = y / verticalSamplingFactor + 4 * v;
+            const uint chromaCol = x / horizontalSamplingFactor + 4 * h;
+            out[y * 8 + x] = chroma[chromaRow * 8 + chromaCol];
+        }
+    }
+}
+
+int clamp(const int value) {
+    if (value < 0) return 0;
+    if (value > 255) return 255;
+    return value;
+}
+
+void YCbCrToRGBScalar(int* const y, const int* const cb, const int* const cr, int* const g, int* const b) {
+    for (uint i = 0; i < 64; i++) {
+        const int red = y[i] + 1.402f * cr[i] + 128;
+        const int green = y[i] - 0.344f * cb[i] - 0.714f * cr[i] + 128;
+        const int blue = y[i] + 1.772f * cb[i] + 128;
+        y[i] = clamp(red);
+        g[i] = clamp(green);
+        b[i] = clamp(blue);
+    }
+}
+
+std::size_t refillScalar(const byte* const data, const std::size_t size, std::size_t nextByte,
+        unsigned long long& bitBuffer, uint& bitCount) {
+    while (bitCount <= 56 && nextByte < size) {
+        bitBuffer |= (unsigned long long)data[nextByte] << (56 - bitCount);
+        nextByte += 1;
+        bitCount += 8;
+    }
+    return nextByte;
+}
+
+const Kernels scalarKernels = {
+    "scalar",
+    inverseDCT4x4Scalar,
+    inverseDCTFullScalar,
+    upsampleScalar,
+    YCbCrToRGBScalar,
+    refillScalar
+};
+
+const Kernels* kernels = &scalarKernels;
+
+#ifdef X86_KERNELS
+
+// refill has no use for vector registers, but every x86 level can load 8 bytes at once
+std::size_t refillWide(const byte* const data, const std::size_t size, std::size_t nextByte,
+        unsigned long long& bitBuffer, uint& bitCount) {
+    if (nextByte + 8 > size) {
+        return refillScalar(data, size, nextByte, bitBuffer, bitCount);
+    }
+    unsigned long long word;
+    std::memcpy(&word, data + nextByte, 8);
+    word = __builtin_bswap64(word);
+
+    const uint numOfBytes = (64 - bitCount) / 8;
+    if (numOfBytes == 0) {
+        return nextByte;
+    }
+    if (numOfBytes < 8) {
+        word &= ~(~0ull >> (numOfBytes * 8));
+    }
+    bitBuffer |= word >> bitCount;
+    bitCount += numOfBytes * 8;
+    return nextByte + numOfBytes;
+}
+
+// SSE2 ==================================================================
+
+__attribute__((target("sse2")))
+void inverseDCTRowsSSE2(int* const component, const float* const temp, const uint numOfColumns) {
+    for (uint y = 0; y < 8; y++) {
+        __m128 sumLow = _mm_setzero_ps();
+        __m128 sumHigh = _mm_setzero_ps();
+        for (uint u = 0; u < numOfColumns; u++) {
+            const __m128 t = _mm_set1_ps(temp[y * 8 + u]);
+            sumLow = _mm_add_ps(sumLow, _mm_mul_ps(_mm_loadu_ps(&idctMap.m[u][0]), t));
+            sumHigh = _mm_add_ps(sumHigh, _mm_mul_ps(_mm_loadu_ps(&idctMap.m[u][4]), t));
+        }
+        _mm_storeu_si128((__m128i*)&component[y * 8], _mm_cvtps_epi32(sumLow));
+        _mm_storeu_si128((__m128i*)&component[y * 8 + 4], _mm_cvtps_epi32(sumHigh));
+    }
+}
+
+__attribute__((target("sse2")))
+void inverseDCT4x4SSE2(int* const component) {
+    float temp[64];
+    for (uint y = 0; y < 8; y++) {
+        __m128 sum = _mm_setzero_ps();
+        for (uint v = 0; v < 4; v++) {
+            const __m128 coefficients = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&component[v * 8]));
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(idctMap.m[v][y]), coefficients));
+        }
+        _mm_storeu_ps(&temp[y * 8], sum);
+    }
+    inverseDCTRowsSSE2(component, temp, 4);
+}
+
+__attribute__((target("sse2")))
+void inverseDCTFullSSE2(int* const component, const byte nonzeroRows) {
+    float temp[64];
+    for (uint y = 0; y < 8; y++) {
+        __m128 sumLow = _mm_setzero_ps();
+        __m128 sumHigh = _mm_setzero_ps();
+        for (uint v = 0; v < 8; v++) {
+            if (nonzeroRows & (1 << v)) {
+                const __m128 m = _mm_set1_ps(idctMap.m[v][y]);
+                const __m128 low = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&component[v * 8]));
+                const __m128 high = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&component[v * 8 + 4]));
+                sumLow = _mm_add_ps(sumLow, _mm_mul_ps(m, low));
+                sumHigh = _mm_add_ps(sumHigh, _mm_mul_ps(m, high));
+            }
+        }
+        _mm_storeu_ps(&temp[y * 8], sumLow);
+        _mm_storeu_ps(&temp[y * 8 + 4], sumHigh);
+    }
+    inverseDCTRowsSSE2(component, temp, 8);
+}
+
+__attribute__((target("sse2")))
+void upsampleSSE2(const int* const chroma, int* const out, const uint horizontalSamplingFactor,
+        const uint verticalSamplingFactor, const uint v, const uint h) {
+    for (uint y = 0; y < 8; y++) {
+        const int* const row = chroma + (y / verticalSamplingFactor + 4 * v) * 8 + 4 * h;
+        if (horizontalSamplingFactor == 2) {
+            const __m128i values = _mm_loadu_si128((const __m128i*)row);
+            _mm_storeu_si128((__m128i*)&out[y * 8], _mm_unpacklo_epi32(values, values));
+            _mm_storeu_si128((__m128i*)&out[y * 8 + 4], _mm_unpackhi_epi32(values, values));
+        } else {
+            _mm_storeu_si128((__m128i*)&out[y * 8], _mm_loadu_si128((const __m128i*)row));
+            _mm_storeu_si128((__m128i*)&out[y * 8 + 4], _mm_loadu_si128((const __m128i*)(row + 4)));
+        }
+    }
+}
+
+// clamping before truncating gives the same result as the scalar truncate then clamp
+__attribute__((target("sse2")))
+__m128i clampToByteSSE2(const __m128 value) {
+    return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(255.0f)));
+}
+
+__attribute__((target("sse2")))
+void YCbCrToRGBSSE2(int* const y, const int* const cb, const int* const cr, int* const g, int* const b) {
+    const __m128 offset = _mm_set1_ps(128.0f);
+    for (uint i = 0; i < 64; i += 4) {
+        const __m128 luminance = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&y[i]));
+        const __m128 blueDifference = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&cb[i]));
+        const __m128 redDifference = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)&cr[i]));
+        const __m128 red = _mm_add_ps(_mm_add_ps(luminance, _mm_mul_ps(_mm_set1_ps(1.402f), redDifference)), offset);
+        const __m128 green = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(luminance,
+                _mm_mul_ps(_mm_set1_ps(0.344f), blueDifference)), _mm_mul_ps(_mm_set1_ps(0.714f), redDifference)), offset);
+        const __m128 blue = _mm_add_ps(_mm_add_ps(luminance, _mm_mul_ps(_mm_set1_ps(1.772f), blueDifference)), offset);
+        _mm_storeu_si128((__m128i*)&y[i], clampToByteSSE2(red));
+        _mm_storeu_si128((__m128i*)&g[i], clampToByteSSE2(green));
+        _mm_storeu_si128((__m128i*)&b[i], clampToByteSSE2(blue));
+    }
+}
+
+const Kernels sse2Kernels = {
+    "sse2",
+    inverseDCT4x4SSE2,
+    inverseDCTFullSSE2,
+    upsampleSSE2,
+    YCbCrToRGBSSE2,
+    refillWide
+};
+
+// AVX2 ==================================================================
+
+__attribute__((target("avx2")))
+void inverseDCTRowsAVX2(int* const component, const float* const temp, const uint numOfColumns) {
+    for (uint y = 0; y < 8; y++) {
+        __m256 sum = _mm256_setzero_ps();
+        for (uint u = 0; u < numOfColumns; u++) {
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(&idctMap.m[u][0]), _mm256_set1_ps(temp[y * 8 + u])));
+        }
+        _mm256_storeu_si256((__m256i*)&component[y * 8], _mm256_cvtps_epi32(sum));
+    }
+}
+
+__attribute__((target("avx2")))
+void inverseDCTColumnsAVX2(const int* const component, float* const temp, const byte nonzeroRows) {
+    for (uint y = 0; y < 8; y++) {
+        __m256 sum = _mm256_setzero_ps();
+        for (uint v = 0; v < 8; v++) {
+            if (nonzeroRows & (1 << v)) {
+                const __m256 coefficients = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)&component[v * 8]));
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(idctMap.m[v][y]), coefficients));
+            }
+        }
+        _mm256_storeu_ps(&temp[y * 8], sum);
+    }
+}
+
+// columns 4 to 7 are zero, computing them anyway costs nothing with 8 lanes
+__attribute__((target("avx2")))
+void inverseDCT4x4AVX2(int* const component) {
+    float temp[64];
+    inverseDCTColumnsAVX2(component, temp, 0x0F);
+    inverseDCTRowsAVX2(component, temp, 4);
+}
+
+__attribute__((target("avx2")))
+void inverseDCTFullAVX2(int* const component, const byte nonzeroRows) {
+    float temp[64];
+    inverseDCTColumnsAVX2(component, temp, nonzeroRows);
+    inverseDCTRowsAVX2(component, temp, 8);
+}
+
+__attribute__((target("avx2")))
+void upsampleAVX2(const int* const chroma, int* const out, const uint horizontalSamplingFactor,
+        const uint verticalSamplingFactor, const uint v, const uint h) {
+    const __m256i duplicate = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    for (uint y = 0; y < 8; y++) {
+        const int* const row = chroma + (y / verticalSamplingFactor + 4 * v) * 8 + 4 * h;
+        if (horizontalSamplingFactor == 2) {
+            const __m256i values = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)row));
+            _mm256_storeu_si256((__m256i*)&out[y * 8], _mm256_permutevar8x32_epi32(values, duplicate));
+        } else {
+            _mm256_storeu_si256((__m256i*)&out[y * 8], _mm256_loadu_si256((const __m256i*)row));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+__m256i clampToByteAVX2(const __m256 value) {
+    return _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(255.0f)));
+}
+
+__attribute__((target("avx2")))
+void YCbCrToRGBAVX2(int* const y, const int* const cb, const int* const cr, int* const g, int* const b) {
+    const __m256 offset = _mm256_set1_ps(128.0f);
+    for (uint i = 0; i < 64; i += 8) {
+        const __m256 luminance = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)&y[i]));
+        const __m256 blueDifference = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)&cb[i]));
+        const __m256 redDifference = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)&cr[i]));
+        const __m256 red = _mm256_add_ps(_mm256_add_ps(luminance,
+                _mm256_mul_ps(_mm256_set1_ps(1.402f), redDifference)), offset);
+        const __m256 green = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(luminance,
+                _mm256_mul_ps(_mm256_set1_ps(0.344f), blueDifference)),
+                _mm256_mul_ps(_mm256_set1_ps(0.714f), redDifference)), offset);
+        const __m256 blue = _mm256_add_ps(_mm256_add_ps(luminance,
+                _mm256_mul_ps(_mm256_set1_ps(1.772f), blueDifference)), offset);
+        _mm256_storeu_si256((__m256i*)&y[i], clampToByteAVX2(red));
+        _mm256_storeu_si256((__m256i*)&g[i], clampToByteAVX2(green));
+        _mm256_storeu_si256((__m256i*)&b[i], clampToByteAVX2(blue));
+    }
+}
+
+const Kernels avx2Kernels = {
+    "avx2",
+    inverseDCT4x4AVX2,
+    inverseDCTFullAVX2,
+    upsampleAVX2,
+    YCbCrToRGBAVX2,
+    refillWide
+};
+
+// AVX-512 ===============================================================
+
+// a block row is 8 values, so the inverse DCT works on two rows per register
+// and the upsampling, which only moves 8 values per row, stays at AVX2
+__attribute__((target("avx512f")))
+__m512 pairOfRows(const __m256 first, const __m256 second) {
+    return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castpd256_pd512(_mm256_castps_pd(first)),
+            _mm256_castps_pd(second), 1));
+}
+
+__attribute__((target("avx512f")))
+void inverseDCTFullAVX512(int* const component, const byte nonzeroRows) {
+    float temp[64];
+    for (uint y = 0; y < 8; y += 2) {
+        __m512 sum = _mm512_setzero_ps();
+        for (uint v = 0; v < 8; v++) {
+            if (nonzeroRows & (1 << v)) {
+                const __m256 row = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)&component[v * 8]));
+                const __m512 m = _mm512_mask_blend_ps(0xFF00, _mm512_set1_ps(idctMap.m[v][y]),
+                        _mm512_set1_ps(idctMap.m[v][y + 1]));
+                sum = _mm512_add_ps(sum, _mm512_mul_ps(m, pairOfRows(row, row)));
+            }
+        }
+        _mm512_storeu_ps(&temp[y * 8], sum);
+    }
+    for (uint y = 0; y < 8; y += 2) {
+        __m512 sum = _mm512_setzero_ps();
+        for (uint u = 0; u < 8; u++) {
+            const __m256 m = _mm256_loadu_ps(&idctMap.m[u][0]);
+            const __m512 t = _mm512_mask_blend_ps(0xFF00, _mm512_set1_ps(temp[y * 8 + u]),
+                    _mm512_set1_ps(temp[(y + 1) * 8 + u]));
+            sum = _mm512_add_ps(sum, _mm512_mul_ps(pairOfRows(m, m), t));
+        }
+        _mm512_storeu_si512(&component[y * 8], _mm512_cvtps_epi32(sum));
+    }
+}
+
+__attribute__((target("avx512f")))
+__m512i clampToByteAVX512(const __m512 value) {
+    return _mm512_cvttps_epi32(_mm512_min_ps(_mm512_max_ps(value, _mm512_setzero_ps()), _mm512_set1_ps(255.0f)));
+}
+
+__attribute__((target("avx512f")))
+void YCbCrToRGBAVX512(int* const y, const int* const cb, const int* const cr, int* const g, int* const b) {
+    const __m512 offset = _mm512_set1_ps(128.0f);
+    for (uint i = 0; i < 64; i += 16) {
+        const __m512 luminance = _mm512_cvtepi32_ps(_mm512_loadu_si512(&y[i]));
+        const __m512 blueDifference = _mm512_cvtepi32_ps(_mm512_loadu_si512(&cb[i]));
+        const __m512 redDifference = _mm512_cvtepi32_ps(_mm512_loadu_si512(&cr[i]));
+        const __m512 red = _mm512_add_ps(_mm512_add_ps(luminance,
+                _mm512_mul_ps(_mm512_set1_ps(1.402f), redDifference)), offset);
+        const __m512 green = _mm512_add_ps(_mm512_sub_ps(_mm512_sub_ps(luminance,
+                _mm512_mul_ps(_mm512_set1_ps(0.344f), blueDifference)),
+                _mm512_mul_ps(_mm512_set1_ps(0.714f), redDifference)), offset);
+        const __m512 blue = _mm512_add_ps(_mm512_add_ps(luminance,
+                _mm512_mul_ps(_mm512_set1_ps(1.772f), blueDifference)), offset);
+        _mm512_storeu_si512(&y[i], clampToByteAVX512(red));
+        _mm512_storeu_si512(&g[i], clampToByteAVX512(green));
+        _mm512_storeu_si512(&b[i], clampToByteAVX512(blue));
+    }
+}
+
+const Kernels avx512Kernels = {
+    "avx512",
+    inverseDCT4x4AVX2,
+    inverseDCTFullAVX512,
+    upsampleAVX2,
+    YCbCrToRGBAVX512,
+    refillWide
+};
+
+#endif  // X86_KERNELS
+
+SIMDLevel detectSIMDLevel() {
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SIMD_SSE2;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+bool parseSIMDLevel(const std::string& name, SIMDLevel& level) {
+    if (name == "scalar") {
+        level = SIMD_SCALAR;
+    } else if (name == "sse2") {
+        level = SIMD_SSE2;
+    } else if (name == "avx2") {
+        level = SIMD_AVX2;
+    } else if (name == "avx512") {
+        level = SIMD_AVX512;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void selectKernels(SIMDLevel level) {
+    const SIMDLevel supported = detectSIMDLevel();
+    if (level > supported) {
+        std::cerr << "Error - SIMD level not supported by this CPU, using the best supported level\n";
+        level = supported;
+    }
+
+    kernels = &scalarKernels;
+#ifdef X86_KERNELS
+    if (level == SIMD_SSE2) {
+        kernels = &sse2Kernels;
+    } else if (level == SIMD_AVX2) {
+        kernels = &avx2Kernels;
+    } else if (level == SIMD_AVX512) {
+        kernels = &avx512Kernels;
+    }
+#endif
+}
@@ -0,0 +1,49 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <string>
+
+#include "jpg.h"
+
+// instruction set levels, every level can run the kernels of the levels below it
+enum SIMDLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_AVX2 = 2,
+    SIMD_AVX512 = 3
+};
+
+// the hot loops of the decoder, one table per instruction set level
+struct Kernels {
+    const char* name;
+
+    // inverse DCT of one component block in place, coefficients in natural order
+    void (*inverseDCT4x4)(int* const component);
+    void (*inverseDCTFull)(int* const component, const byte nonzeroRows);
+
+    // the 8x8 chroma values of the block at (v, h) inside an MCU from the chroma block of the MCU
+    void (*upsample)(const int* const chroma, int* const out, const uint horizontalSamplingFactor,
+            const uint verticalSamplingFactor, const uint v, const uint h);
+
+    // r is written over y, g and b may point to the memory of cb and cr
+    void (*YCbCrToRGB)(int* const y, const int* const cb, const int* const cr, int* const g, int* const b);
+
+    // load whole bytes of data into the most significant free bits of bitBuffer, returns the new nextByte
+    std::size_t (*refill)(const byte* const data, const std::size_t size, std::size_t nextByte,
+            unsigned long long& bitBuffer, uint& bitCount);
+};
+
+// kernels picked by selectKernels(), scalar until then
+extern const Kernels* kernels;
+
+// only the DC coefficient is nonzero, not worth a kernel per level
+void inverseDCTDCOnly(int* const component);
+
+SIMDLevel detectSIMDLevel();
+bool parseSIMDLevel(const std::string& name, SIMDLevel& level);
+
+// use the kernels of level, or of the best supported level if level is not supported
+void selectKernels(SIMDLevel level);
+
+#endif  // KERNELS_H
@@ -0,0 +1,370 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "decoder.h"
+
+// clients can not make a worker hold more than this for one request
+const std::size_t maxLineLength = 4096;
+const std::size_t maxInlineSize = std::size_t(256) << 20;
+// pixels of an image padded to whole MCUs, enough for 8K frames. A tiny file can ask for any size
+// and the MCUs of every pixel are allocated before the scan is decoded.
+const std::size_t maxPixels = std::size_t(32) << 20;
+
+// one client connection, reads are buffered so that a request line does not take a system call per byte
+struct Connection {
+    int fd = -1;
+    char buffer[4096];
+    std::size_t begin = 0;      // unread bytes of buffer
+    std::size_t end = 0;
+};
+
+enum LineStatus {
+    LINE_READ,
+    LINE_CLOSED,
+    LINE_TOO_LONG
+};
+
+// read until the next '\n', which is not included in line
+LineStatus readLine(Connection& connection, std::string& line) {
+    line.clear();
+    while (true) {
+        if (connection.begin == connection.end) {
+            const ssize_t n = read(connection.fd, connection.buffer, sizeof(connection.buffer));
+            if (n <= 0) {
+                return LINE_CLOSED;
+            }
+            connection.begin = 0;
+            connection.end = n;
+        }
+        const char* const begin = connection.buffer + connection.begin;
+        const char* const newline = (const char*)std::memchr(begin, '\n', connection.end - connection.begin);
+        const std::size_t length = (newline == nullptr) ? connection.end - connection.begin : newline - begin;
+        if (line.size() + length > maxLineLength) {
+            return LINE_TOO_LONG;
+        }
+        line.append(begin, length);
+        connection.begin += length;
+        if (newline != nullptr) {
+            connection.begin += 1;
+            return LINE_READ;
+        }
+    }
+}
+
+bool readExact(Connection& connection, byte* data, std::size_t size) {
+    // bytes which came in with the request line first
+    const std::size_t buffered = std::min(size, connection.end - connection.begin);
+    std::memcpy(data, connection.buffer + connection.begin, buffered);
+    connection.begin += buffered;
+    data += buffered;
+    size -= buffered;
+
+    const int fd = connection.fd;
+    while (size > 0) {
+        const ssize_t n = read(fd, data, size);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool writeExact(const int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        const ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool writeError(const int fd, const std::string& message) {
+    const std::string response = "ERROR " + message + "\n";
+    return writeExact(fd, response.data(), response.size());
+}
+
+// read a whole file of at most maxSize bytes into data, which keeps its capacity
+bool readFile(const std::string& path, std::vector<byte>& data, const std::size_t maxSize) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat status;
+    bool valid = fstat(fd, &status) == 0 && (std::size_t)status.st_size <= maxSize;
+    if (valid) {
+        data.resize(status.st_size);
+        std::size_t size = 0;
+        while (valid && size < data.size()) {
+            const ssize_t n = read(fd, data.data() + size, data.size() - size);
+            valid = n > 0 || (n == -1 && errno == EINTR);
+            size += (n > 0) ? n : 0;
+        }
+    }
+    close(fd);
+    return valid;
+}
+
+// what a worker keeps from one request to the next, so that requests which are like
+// the ones before need no new memory
+struct Worker {
+    DecoderContext context;
+    TableCache tables;          // DQT and DHT segments of earlier requests
+    std::string line;
+    std::string value;          // value of the option being parsed
+    std::string path;
+    std::vector<byte> bitmap;
+};
+
+// find the next word of line after end, it is [begin, end)
+bool nextWord(const std::string& line, std::size_t& begin, std::size_t& end) {
+    begin = line.find_first_not_of(" \t\r", end);
+    if (begin == std::string::npos) {
+        return false;
+    }
+    end = std::min(line.find_first_of(" \t\r", begin), line.size());
+    return true;
+}
+
+bool writeStatus(const int fd, const uint width, const uint height, const std::string& format, const std::size_t size) {
+    char status[128];
+    const int length = std::snprintf(status, sizeof(status), "OK %u %u %s %zu\n", width, height, format.c_str(), size);
+    return writeExact(fd, status, length);
+}
+
+// handle one request line of the form
+//   DECODE (path=<file> | inline=<size>) [format=rgb|bmp|i420|nv12|yuv444] [scale=1|2|4|8] [crop=<x>,<y>,<w>,<h>]
+// where inline=<size> is followed by size bytes of JPEG data. Successful responses are
+//   OK <width> <height> <format> <size>
+// followed by size bytes of raw top-down RGB pixels, an encoded bitmap or the YCbCr planes
+// one after the other. Planar formats are only given for the whole image.
+bool handleRequest(Connection& connection, Worker& worker) {
+    const int fd = connection.fd;
+    const std::string& line = worker.line;
+    DecoderContext& context = worker.context;
+    std::size_t begin = 0;
+    std::size_t end = 0;
+    if (!nextWord(line, begin, end) || line.compare(begin, end - begin, "DECODE") != 0) {
+        return writeError(fd, "unknown command");
+    }
+
+    std::string& path = worker.path;
+    path.clear();
+    std::size_t inlineSize = 0;
+    bool inlineData = false;
+    std::string format = "rgb";
+    uint scale = 1;
+    uint cropX = 0;
+    uint cropY = 0;
+    uint cropWidth = 0;
+    uint cropHeight = 0;
+    bool crop = false;
+
+    std::string& value = worker.value;
+    while (nextWord(line, begin, end)) {
+        const std::size_t keyEnd = std::min(line.find('=', begin), end);
+        const std::size_t keySize = keyEnd - begin;
+        value.assign(line, std::min(keyEnd + 1, end), end - std::min(keyEnd + 1, end));
+        if (line.compare(begin, keySize, "path") == 0) {
+            path = value;
+        } else if (line.compare(begin, keySize, "inline") == 0) {
+            inlineSize = std::strtoul(value.c_str(), nullptr, 10);
+            inlineData = true;
+        } else if (line.compare(begin, keySize, "format") == 0) {
+            format = value;
+        } else if (line.compare(begin, keySize, "scale") == 0) {
+            scale = std::strtoul(value.c_str(), nullptr, 10);
+        } else if (line.compare(begin, keySize, "crop") == 0) {
+            crop = std::sscanf(value.c_str(), "%u,%u,%u,%u", &cropX, &cropY, &cropWidth, &cropHeight) == 4;
+            if (!crop) {
+                return writeError(fd, "invalid crop");
+            }
+        } else {
+            return writeError(fd, "unknown option " + line.substr(begin, keySize));
+        }
+    }
+
+    // the inline bytes have to be consumed even if the request turns out to be invalid,
+    // too many of them end the connection
+    if (inlineData) {
+        if (inlineSize > maxInlineSize) {
+            writeError(fd, "inline data larger than " + std::to_string(maxInlineSize) + " bytes");
+            return false;
+        }
+        context.input.resize(inlineSize);
+        if (!readExact(connection, context.input.data(), inlineSize)) {
+            return false;
+        }
+    }
+
+    if (inlineData == !path.empty()) {
+        return writeError(fd, "exactly one of path and inline is required");
+    }
+    PlanarFormat planarFormat = PLANAR_I420;
+    const bool planar = parsePlanarFormat(format, planarFormat);
+    if (format != "rgb" && format != "bmp" && !planar) {
+        return writeError(fd, "unknown format " + format);
+    }
+    if (planar && (crop || scale != 1)) {
+        return writeError(fd, "crop and scale need format rgb or bmp");
+    }
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+        return writeError(fd, "invalid scale");
+    }
+
+    if (!inlineData && !readFile(path, context.input, maxInlineSize)) {
+        return writeError(fd, "input file cannot be read");
+    }
+    if (!startImage(context)) {
+        return writeError(fd, "out of memory");
+    }
+    Header* const header = context.header;
+    MemoryBuffer buffer(context.input.data(), context.input.size());
+    std::istream inFile(&buffer);
+    readJPG(inFile, header, &worker.tables);
+    if (header->valid == false) {
+        return writeError(fd, std::string("invalid header: ") + header->error);
+    }
+    if ((std::size_t)header->mcuHeightReal * header->mcuWidthReal * 64 > maxPixels) {
+        return writeError(fd, "image too large");
+    }
+
+    if (!crop) {
+        cropWidth = header->width;
+        cropHeight = header->height;
+    }
+    // compared without adding to the offsets, which could wrap around
+    if (cropWidth == 0 || cropHeight == 0 || cropX > header->width || cropWidth > header->width - cropX ||
+            cropY > header->height || cropHeight > header->height - cropY) {
+        return writeError(fd, "crop outside of image");
+    }
+
+    if (planar) {
+        if (!decodeImageYCbCr(context)) {
+            return writeError(fd, "invalid huffman data");
+        }
+        Plane planes[3];
+        context.pixels.resize(planarSize(planarFormat, header->width, header->height));
+        packedPlanes(planarFormat, header->width, header->height, context.pixels.data(), planes);
+        writePlanarYCbCr(header, context.mcus, planarFormat, planes);
+
+        return writeStatus(fd, header->width, header->height, format, context.pixels.size()) &&
+            writeExact(fd, (const char*)context.pixels.data(), context.pixels.size());
+    }
+
+    if (!decodeImage(context)) {
+        return writeError(fd, "invalid huffman data");
+    }
+
+    extractRGB(header, context.mcus, cropX, cropY, cropWidth, cropHeight, scale, context.pixels);
+    const uint width = (cropWidth + scale - 1) / scale;
+    const uint height = (cropHeight + scale - 1) / scale;
+
+    const std::vector<byte>* payload = &context.pixels;
+    if (format == "bmp") {
+        writeBMP(worker.bitmap, width, height, context.pixels.data());
+        payload = &worker.bitmap;
+    }
+    return writeStatus(fd, width, height, format, payload->size()) &&
+        writeExact(fd, (const char*)payload->data(), payload->size());
+}
+
+// every worker accepts connections on the shared socket and serves
+// the requests of one connection at a time with its own warm buffers
+void serveWorker(const int listenFd) {
+    Worker worker;
+    warmDecoderContext(worker.context);
+    worker.line.reserve(maxLineLength);
+    worker.value.reserve(maxLineLength);
+    worker.path.reserve(maxLineLength);
+
+    Connection connection;
+    while (true) {
+        connection.fd = accept(listenFd, nullptr, nullptr);
+        if (connection.fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        connection.begin = 0;
+        connection.end = 0;
+        while (true) {
+            const LineStatus status = readLine(connection, worker.line);
+            if (status == LINE_TOO_LONG) {
+                writeError(connection.fd, "request line longer than " + std::to_string(maxLineLength) + " bytes");
+            }
+            if (status != LINE_READ || !handleRequest(connection, worker)) {
+                break;
+            }
+        }
+        close(connection.fd);
+    }
+}
+
+int serve(const std::string& socketPath, uint numOfThreads) {
+    const int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd == -1) {
+        std::cout << "Error - socket could not be created\n";
+        return 1;
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cout << "Error - socket path is too long\n";
+        close(listenFd);
+        return 1;
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+    // a socket left behind by an earlier server is replaced, anything else at the path is kept
+    struct stat status;
+    if (lstat(socketPath.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            std::cout << "Error - socket path exists and is not a socket --" << socketPath << "--\n";
+            close(listenFd);
+            return 1;
+        }
+        unlink(socketPath.c_str());
+    }
+
+    if (bind(listenFd, (sockaddr*)&address, sizeof(address)) == -1 || listen(listenFd, 64) == -1) {
+        std::cout << "Error - socket could not be bound to --" << socketPath << "--\n";
+        close(listenFd);
+        return 1;
+    }
+
+    if (numOfThreads == 0) {
+        numOfThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::cout << "Serving on --" << socketPath << "-- with " << numOfThreads << " threads\n";
+
+    std::vector<std::thread> workers;
+    for (uint i = 0; i < numOfThreads; i++) {
+        workers.emplace_back(serveWorker, listenFd);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    close(listenFd);
+    return 0;
+}
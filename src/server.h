@@ -0,0 +1,12 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+
+#include "jpg.h"
+
+// decode the images clients ask for on a unix socket at socketPath with numOfThreads workers,
+// 0 for one per core. Returns 1 if the socket could not be set up and 0 once accepting fails.
+int serve(const std::string& socketPath, uint numOfThreads);
+
+#endif  // SERVER_H
@@ -0,0 +1,203 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+#include "verify.h"
+
+const char* verifyStatusName(const VerifyStatus status) {
+    switch (status) {
+        case VERIFY_OK:
+            return "OK";
+        case VERIFY_INVALID_HEADER:
+            return "invalid header";
+        case VERIFY_INVALID_SCAN:
+            return "invalid scan";
+        case VERIFY_INVALID_RESTART:
+            return "invalid restart marker";
+        case VERIFY_TRUNCATED:
+            return "truncated";
+        default:
+            return "unknown";
+    }
+}
+
+// copy the entropy coded bytes from data[begin] up to the next marker into out without stuffed
+// zeros, stuffedBytes gets the index in out of every 0xFF which was followed by a stuffed zero.
+// Returns the offset of the marker, or size if the data ends first.
+std::size_t readEntropySegment(const byte* const data, const std::size_t size, std::size_t begin,
+        ArenaVector<byte>& out, std::vector<std::size_t>& stuffedBytes) {
+    out.clear();
+    stuffedBytes.clear();
+    while (begin < size) {
+        const byte* const next = (const byte*)std::memchr(data + begin, 0xFF, size - begin);
+        const std::size_t end = (next == nullptr) ? size : next - data;
+        out.insert(out.end(), data + begin, data + end);
+        if (end + 1 >= size) {
+            return size;
+        }
+        if (data[end + 1] == 0x00) {
+            stuffedBytes.push_back(out.size());
+            out.push_back(0xFF);
+            begin = end + 2;
+        } else if (data[end + 1] == 0xFF) {
+            // any number of 0xFF may come before a marker
+            begin = end + 1;
+        } else {
+            return end;
+        }
+    }
+    return size;
+}
+
+VerifyResult verifyJPG(DecoderContext& context, const byte* const data, const std::size_t size) {
+    VerifyResult result;
+    if (!startImage(context)) {
+        result.status = VERIFY_INVALID_HEADER;
+        result.message = "Memory could not be allocated for Header";
+        return result;
+    }
+    Header* const header = context.header;
+
+    MemoryBuffer buffer(data, size);
+    std::istream inFile(&buffer);
+    readFrameHeader(inFile, header, nullptr);
+    if (header->valid) {
+        validateHeader(header, nullptr);
+    }
+    if (!header->valid) {
+        result.status = inFile ? VERIFY_INVALID_HEADER : VERIFY_TRUNCATED;
+        result.offset = std::min(buffer.consumed(), size);
+        result.message = header->error;
+        return result;
+    }
+
+    generateCodes(header);
+    const uint numOfMCUs = ((header->mcuHeight + header->verticalSamplingFactor - 1) / header->verticalSamplingFactor) *
+        ((header->mcuWidth + header->horizontalSamplingFactor - 1) / header->horizontalSamplingFactor);
+    const uint interval = (header->restartInterval != 0) ? header->restartInterval : numOfMCUs;
+
+    ArenaVector<byte>& segment = header->huffmanData;
+    std::vector<std::size_t> stuffedBytes;
+    std::size_t begin = buffer.consumed();
+    // no segment is longer than the rest of the file
+    segment.reserve(size - std::min(begin, size));
+    int block[64] = { 0 };
+    uint mcu = 0;
+
+    for (uint restart = 0; ; restart++) {
+        const std::size_t marker = readEntropySegment(data, size, begin, segment, stuffedBytes);
+        // offset in the file of a byte of segment
+        auto fileOffset = [&](const std::size_t i) {
+            return begin + i + (std::lower_bound(stuffedBytes.begin(), stuffedBytes.end(), i) - stuffedBytes.begin());
+        };
+        const byte markerType = (marker < size) ? data[marker + 1] : 0;
+        std::ostringstream message;
+
+        BitReader b(segment);
+        int previousDCs[3] = { 0 };
+        for (const uint end = std::min(numOfMCUs, mcu + interval); mcu < end; mcu++) {
+            for (uint i = 0; i < header->numOfComponents; i++) {
+                const ColorComponent& component = header->colorComponents[i];
+                for (uint j = 0; j < component.verticalSamplingFactor * component.horizontalSamplingFactor; j++) {
+                    byte endOfBlock = 0;
+                    byte nonzeroRows = 0;
+                    const char* error = decodeBlock(b, block, header->huffmanDCTables[component.huffmanDCTableID],
+                            header->huffmanACTables[component.huffmanACTableID], endOfBlock, nonzeroRows);
+                    std::memset(block, 0, sizeof(block));
+                    if (error == nullptr) {
+                        previousDCs[i] += block[0];
+                        // 11 bit DC coefficients of 8 bit samples
+                        if (previousDCs[i] < -2047 || previousDCs[i] > 2047) {
+                            error = "DC coefficient out of range";
+                        }
+                    }
+                    if (error == nullptr) {
+                        continue;
+                    }
+
+                    if (!b.ranOut()) {
+                        result.status = VERIFY_INVALID_SCAN;
+                        message << error << " in MCU " << mcu;
+                    } else if (marker >= size) {
+                        result.status = VERIFY_TRUNCATED;
+                        message << "File ended in MCU " << mcu << " of " << numOfMCUs;
+                    } else if (markerType == EOI) {
+                        // the file is complete, so the data went wrong somewhere before
+                        result.status = VERIFY_INVALID_SCAN;
+                        message << "Scan data ended at EOI in MCU " << mcu << " of " << numOfMCUs;
+                    } else {
+                        result.status = VERIFY_INVALID_RESTART;
+                        message << "Marker 0x" << std::hex << (uint)markerType << std::dec << " in MCU " << mcu;
+                    }
+                    result.offset = fileOffset(std::min(b.position() / 8, segment.size()));
+                    result.message = message.str();
+                    return result;
+                }
+            }
+        }
+
+        // only the padding of the last byte may be left
+        if (segment.size() * 8 - b.position() >= 8) {
+            result.offset = fileOffset((b.position() + 7) / 8);
+            if (mcu < numOfMCUs) {
+                result.status = VERIFY_INVALID_RESTART;
+                message << "Expected RST" << (restart % 8) << " after MCU " << (mcu - 1) << ", found more data";
+            } else {
+                result.status = VERIFY_INVALID_SCAN;
+                message << "Data left over after the last MCU";
+            }
+            result.message = message.str();
+            return result;
+        }
+        if (marker >= size) {
+            result.status = VERIFY_TRUNCATED;
+            result.offset = size;
+            result.message = "File ended before EOI";
+            return result;
+        }
+        result.offset = marker;
+        if (mcu == numOfMCUs) {
+            if (markerType == EOI) {
+                return VerifyResult();
+            }
+            result.status = (RST0 <= markerType && markerType <= RST7) ? VERIFY_INVALID_RESTART : VERIFY_INVALID_SCAN;
+            message << "Expected EOI after the last MCU, found marker 0x" << std::hex << (uint)markerType;
+            result.message = message.str();
+            return result;
+        }
+        if (markerType != RST0 + restart % 8) {
+            result.status = VERIFY_INVALID_RESTART;
+            message << "Expected RST" << (restart % 8) << " after MCU " << (mcu - 1) << ", found marker 0x"
+                << std::hex << (uint)markerType;
+            result.message = message.str();
+            return result;
+        }
+        begin = marker + 2;
+    }
+}
+
+int verifyFiles(const std::vector<std::string>& filenames) {
+    DecoderContext context;
+    int status = 0;
+    for (const std::string& filename : filenames) {
+        std::ifstream inFile = std::ifstream(filename, std::ios::in | std::ios::binary);
+        if (!inFile.is_open()) {
+            std::cout << "Error, input file cannot be opened --" << filename << "--\n";
+            status = 1;
+            continue;
+        }
+        context.input.assign(std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>());
+
+        const VerifyResult result = verifyJPG(context, context.input.data(), context.input.size());
+        if (result.status == VERIFY_OK) {
+            std::cout << filename << ": OK\n";
+        } else {
+            std::cout << filename << ": " << verifyStatusName(result.status) << " at byte " << result.offset
+                << ": " << result.message << "\n";
+            status = 1;
+        }
+    }
+    return status;
+}
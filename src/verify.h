@@ -0,0 +1,34 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "decoder.h"
+
+enum VerifyStatus {
+    VERIFY_OK,
+    VERIFY_INVALID_HEADER,      // a marker segment or a table reference is invalid or not supported
+    VERIFY_INVALID_SCAN,        // a huffman code or coefficient is invalid, or data is left over
+    VERIFY_INVALID_RESTART,     // a restart marker is missing, out of order or in the wrong place
+    VERIFY_TRUNCATED            // the file ends before the last MCU or before EOI
+};
+
+const char* verifyStatusName(const VerifyStatus status);
+
+struct VerifyResult {
+    VerifyStatus status = VERIFY_OK;
+    std::size_t offset = 0;     // byte of the file where the problem was found
+    std::string message;
+};
+
+// check a whole image without reconstructing it: every marker and table reference, every huffman
+// code and coefficient range of every MCU, the order of the restart markers and the EOI.
+// Uses the header of the context and its huffman data as the buffer for one restart interval.
+VerifyResult verifyJPG(DecoderContext& context, const byte* const data, const std::size_t size);
+
+// print one line per file, returns 0 if every file is valid
+int verifyFiles(const std::vector<std::string>& filenames);
+
+#endif  // VERIFY_H